@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <chimaera.h>
+
+// Binary capture of a chimaera event and dump stream.
+//
+// A file starts with a capture_header_t, followed by records. Each record has
+// a capture_record_t header with the frame distance to the previous record at
+// the capture's sample rate, followed by its payload padded to 4 bytes. All
+// fields are in host byte order, captures are meant to be replayed on the
+// machine they were taken on.
+
+#define CAPTURE_MAGIC "CHIMCAP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_PAD(SIZE) ( ( (SIZE) + 3U) & ~3U)
+
+typedef enum _capture_type_t capture_type_t;
+typedef struct _capture_header_t capture_header_t;
+typedef struct _capture_record_t capture_record_t;
+typedef struct _capture_event_t capture_event_t;
+
+enum _capture_type_t {
+	CAPTURE_TYPE_EVENT	= 0,
+	CAPTURE_TYPE_DUMP		= 1
+};
+
+struct _capture_header_t {
+	char magic [8];
+	uint32_t version;
+	uint32_t rate;
+};
+
+struct _capture_record_t {
+	uint32_t delta; // frames since previous record
+	uint16_t type;
+	uint16_t size; // payload size without padding
+};
+
+struct _capture_event_t {
+	uint32_t sid;
+	uint16_t pid;
+	uint8_t gid;
+	uint8_t state;
+	float x;
+	float z;
+	float X;
+	float Z;
+};
+
+static inline void
+capture_header_init(capture_header_t *header, uint32_t rate)
+{
+	memset(header, 0x0, sizeof(capture_header_t));
+	strcpy(header->magic, CAPTURE_MAGIC);
+	header->version = CAPTURE_VERSION;
+	header->rate = rate;
+}
+
+static inline int
+capture_header_check(const capture_header_t *header)
+{
+	return !strncmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic))
+		&& (header->version == CAPTURE_VERSION);
+}
+
+// serializes an event record into dst, returns the record size
+static inline uint32_t
+capture_event_write(uint8_t *dst, uint32_t delta, const chimaera_event_t *cev)
+{
+	capture_record_t *rec = (capture_record_t *)dst;
+	capture_event_t *body = (capture_event_t *)(dst + sizeof(capture_record_t));
+
+	rec->delta = delta;
+	rec->type = CAPTURE_TYPE_EVENT;
+	rec->size = sizeof(capture_event_t);
+
+	body->sid = cev->sid;
+	body->pid = cev->pid;
+	body->gid = cev->gid;
+	body->state = cev->state;
+	body->x = cev->x;
+	body->z = cev->z;
+	body->X = cev->X;
+	body->Z = cev->Z;
+
+	return sizeof(capture_record_t) + sizeof(capture_event_t);
+}
+
+// serializes a dump record into dst as 16-bit values, returns the record size
+static inline uint32_t
+capture_dump_write(uint8_t *dst, uint32_t delta, const int32_t *values,
+	uint32_t sensors)
+{
+	capture_record_t *rec = (capture_record_t *)dst;
+	int16_t *body = (int16_t *)(dst + sizeof(capture_record_t));
+
+	rec->delta = delta;
+	rec->type = CAPTURE_TYPE_DUMP;
+	rec->size = sensors * sizeof(int16_t);
+
+	for(uint32_t i=0; i<sensors; i++)
+		body[i] = values[i];
+	if(sensors & 1)
+		body[sensors] = 0; // padding
+
+	return sizeof(capture_record_t) + CAPTURE_PAD(rec->size);
+}
+
+static inline uint32_t
+capture_dump_size(uint32_t sensors)
+{
+	return sizeof(capture_record_t) + CAPTURE_PAD(sensors * sizeof(int16_t));
+}
+
+// returns the record at *ptr and advances *ptr past it, NULL when truncated
+static inline const capture_record_t *
+capture_record_next(const uint8_t **ptr, const uint8_t *end)
+{
+	const capture_record_t *rec = (const capture_record_t *)*ptr;
+
+	if(*ptr + sizeof(capture_record_t) > end)
+		return NULL;
+
+	const uint8_t *next = *ptr + sizeof(capture_record_t) + CAPTURE_PAD(rec->size);
+	if(next > end)
+		return NULL;
+
+	*ptr = next;
+	return rec;
+}
+
+static inline const void *
+capture_record_body(const capture_record_t *rec)
+{
+	return (const uint8_t *)rec + sizeof(capture_record_t);
+}
+
+// returns 0 for records too short to hold an event, which are to be skipped
+static inline int
+capture_event_read(const capture_record_t *rec, chimaera_event_t *cev)
+{
+	const capture_event_t *body = capture_record_body(rec);
+
+	if(rec->size < sizeof(capture_event_t))
+		return 0;
+
+	cev->state = body->state;
+	cev->sid = body->sid;
+	cev->gid = body->gid;
+	cev->pid = body->pid;
+	cev->x = body->x;
+	cev->z = body->z;
+	cev->X = body->X;
+	cev->Z = body->Z;
+	cev->m = 0.f;
+
+	return 1;
+}
+
+// returns the number of sensors
+static inline uint32_t
+capture_dump_read(const capture_record_t *rec, int32_t *values, uint32_t max)
+{
+	const int16_t *body = capture_record_body(rec);
+	uint32_t sensors = rec->size / sizeof(int16_t);
+
+	if(sensors > max)
+		sensors = max;
+
+	for(uint32_t i=0; i<sensors; i++)
+		values[i] = body[i];
+
+	return sensors;
+}
+
+#endif // _CAPTURE_H
@@ -17,6 +17,18 @@
 
 #include <chimaera.h>
 
+#if defined(CHIMAERA_USDT)
+CHIMAERA_PROBE_SEMAPHORE_DEFINE(run_entry);
+CHIMAERA_PROBE_SEMAPHORE_DEFINE(run_exit);
+CHIMAERA_PROBE_SEMAPHORE_DEFINE(forge_overflow);
+CHIMAERA_PROBE_SEMAPHORE_DEFINE(dict_full);
+CHIMAERA_PROBE_SEMAPHORE_DEFINE(tuio2_frm);
+CHIMAERA_PROBE_SEMAPHORE_DEFINE(tuio2_alv);
+CHIMAERA_PROBE_SEMAPHORE_DEFINE(midi_emit);
+CHIMAERA_PROBE_SEMAPHORE_DEFINE(midi_drop);
+CHIMAERA_PROBE_SEMAPHORE_DEFINE(osc_emit);
+#endif
+
 #ifdef _WIN32
 __declspec(dllexport)
 #else
@@ -47,6 +59,12 @@ lv2_descriptor(uint32_t index)
 			return &mogrifier;
 		case 9:
 			return &mpe_out;
+		case 10:
+			return &poly_out;
+		case 11:
+			return &recorder;
+		case 12:
+			return &player;
 		default:
 			return NULL;
 	}
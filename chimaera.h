@@ -19,6 +19,9 @@
 #define _CHIMAERA_LV2_H
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include <lv2/lv2plug.in/ns/lv2core/lv2.h>
 #include <lv2/lv2plug.in/ns/ext/atom/atom.h>
@@ -32,6 +35,9 @@
 #include <lv2/lv2plug.in/ns/ext/log/logger.h>
 #include <lv2/lv2plug.in/ns/extensions/ui/ui.h>
 
+#include <probe.h>
+#include <tlsf.h>
+
 #define _ATOM_ALIGNED __attribute__((aligned(8)))
 
 #if defined(HAS_BUILTIN_ASSUME_ALIGNED)
@@ -55,6 +61,12 @@
 
 // dump uri
 #define CHIMAERA_DUMP_URI					CHIMAERA_URI"#dump"
+#define CHIMAERA_DELTA_URI				CHIMAERA_URI"#delta"
+#define CHIMAERA_SHM_URI					CHIMAERA_URI"#shm"
+#define CHIMAERA_LATENCY_URI			CHIMAERA_URI"#latency"
+
+// universal midi packet event uri
+#define CHIMAERA_UMP_EVENT_URI		CHIMAERA_URI"#UmpEvent"
 
 // plugin uris
 #define CHIMAERA_FILTER_URI				CHIMAERA_URI"#filter"
@@ -67,6 +79,9 @@
 #define CHIMAERA_DRIVER_URI				CHIMAERA_URI"#driver"
 #define CHIMAERA_MOGRIFIER_URI		CHIMAERA_URI"#mogrifier"
 #define CHIMAERA_MIDI_OUT_URI			CHIMAERA_URI"#midi_out"
+#define CHIMAERA_POLY_OUT_URI			CHIMAERA_URI"#poly_out"
+#define CHIMAERA_RECORDER_URI			CHIMAERA_URI"#recorder"
+#define CHIMAERA_PLAYER_URI				CHIMAERA_URI"#player"
 
 extern const LV2_Descriptor filter;
 extern const LV2_Descriptor mapper;
@@ -78,6 +93,9 @@ extern const LV2_Descriptor visualizer;
 extern const LV2_Descriptor driverer;
 extern const LV2_Descriptor mogrifier;
 extern const LV2_Descriptor mpe_out;
+extern const LV2_Descriptor poly_out;
+extern const LV2_Descriptor recorder;
+extern const LV2_Descriptor player;
 
 // ui plugins uris
 #if defined(CHIMAERA_UI_PLUGINS)
@@ -108,8 +126,12 @@ typedef struct _chimaera_event_t	chimaera_event_t;
 typedef struct _chimaera_obj_t		chimaera_obj_t;
 typedef struct _chimaera_pack_t		chimaera_pack_t;
 typedef struct _chimaera_dump_t		chimaera_dump_t;
+typedef struct _chimaera_latency_t	chimaera_latency_t;
+typedef struct _chimaera_latency_pack_t	chimaera_latency_pack_t;
+typedef struct _chimaera_latency_stats_t	chimaera_latency_stats_t;
 typedef struct _chimaera_forge_t	chimaera_forge_t;
 typedef struct _chimaera_dict_t		chimaera_dict_t;
+typedef struct _chimaera_pool_t		chimaera_pool_t;
 
 enum _chimaera_state_t {
 	CHIMAERA_STATE_ON		= 1,
@@ -154,6 +176,30 @@ struct _chimaera_dump_t {
 	int32_t values [0] _ATOM_ALIGNED;
 } _ATOM_ALIGNED;
 
+// latency tag, emitted by the driver after each OSC packet on request,
+// timestamps are CLOCK_MONOTONIC nanoseconds
+struct _chimaera_latency_t {
+	uint64_t arrival; // time the packet's frame corresponds to
+	uint64_t dispatch; // time the driver forged the tag
+	uint64_t timetag; // OSC timetag of the enclosing bundle, 1 if immediate
+};
+
+struct _chimaera_latency_pack_t {
+	chimaera_obj_t cobj _ATOM_ALIGNED;
+
+	LV2_Atom_Long arrival _ATOM_ALIGNED;
+	LV2_Atom_Long dispatch _ATOM_ALIGNED;
+	LV2_Atom_Long timetag _ATOM_ALIGNED;
+} _ATOM_ALIGNED;
+
+// per-block accumulator of latency tags at an output plugin
+struct _chimaera_latency_stats_t {
+	uint32_t n;
+	uint64_t quant; // sum of dispatch - arrival, i.e. block quantization
+	uint64_t chain; // sum of now - dispatch, i.e. processing chain
+	uint64_t max; // maximum of now - arrival
+};
+
 struct _chimaera_forge_t {
 	LV2_Atom_Forge forge;
 
@@ -166,6 +212,9 @@ struct _chimaera_forge_t {
 		LV2_URID idle;
 
 		LV2_URID dump;
+		LV2_URID delta;
+		LV2_URID shm;
+		LV2_URID latency;
 	} uris;
 };
 
@@ -174,6 +223,11 @@ struct _chimaera_dict_t {
 	void *ref;
 };
 
+struct _chimaera_pool_t {
+	void *area;
+	tlsf_t tlsf;
+};
+
 static inline void
 chimaera_forge_init(chimaera_forge_t *cforge, LV2_URID_Map *map)
 {
@@ -187,6 +241,9 @@ chimaera_forge_init(chimaera_forge_t *cforge, LV2_URID_Map *map)
 	cforge->uris.idle = map->map(map->handle, CHIMAERA_STATE_IDLE_URI);
 
 	cforge->uris.dump = map->map(map->handle, CHIMAERA_DUMP_URI);
+	cforge->uris.delta = map->map(map->handle, CHIMAERA_DELTA_URI);
+	cforge->uris.shm = map->map(map->handle, CHIMAERA_SHM_URI);
+	cforge->uris.latency = map->map(map->handle, CHIMAERA_LATENCY_URI);
 
 	lv2_atom_forge_init(forge, map);
 }
@@ -252,6 +309,245 @@ chimaera_dump_check_type(const chimaera_forge_t *cforge, const LV2_Atom *atom)
 	return 0;
 }
 
+// delta dump handling, runs of (index, count, values[count]) relative to
+// the previous dump
+static inline LV2_Atom_Forge_Ref
+chimaera_delta_forge(chimaera_forge_t *cforge, const int32_t *runs, uint32_t n)
+{
+	LV2_Atom_Forge *forge = &cforge->forge;
+	uint32_t runs_size = n * sizeof(int32_t);
+	LV2_Atom_Forge_Ref ref;
+
+	const chimaera_dump_t delta = {
+		.cobj = {
+			.obj = {
+				.atom.type = forge->Object,
+				.atom.size = sizeof(chimaera_dump_t) + runs_size - sizeof(LV2_Atom),
+				.body.id = 0,
+				.body.otype = cforge->uris.delta
+			},
+			.prop = {
+				.key = cforge->uris.delta,
+				.context = 0,
+				.value.type = forge->Vector,
+				.value.size = sizeof(LV2_Atom_Vector_Body) + runs_size
+			}
+		},
+		.vec = {
+			.child_size = sizeof(int32_t),
+			.child_type = forge->Int
+		}
+	};
+
+	ref = lv2_atom_forge_raw(forge, &delta, sizeof(chimaera_dump_t));
+	if(ref)
+		ref = lv2_atom_forge_raw(forge, runs, runs_size);
+	if(ref)
+		lv2_atom_forge_pad(forge, runs_size);
+
+	return ref;
+}
+
+static inline const int32_t *
+chimaera_delta_deforge(const chimaera_forge_t *cforge, const LV2_Atom *atom,
+	uint32_t *n)
+{
+	const chimaera_dump_t *delta = ASSUME_ALIGNED(atom);
+
+	if(n)
+		*n = (delta->cobj.prop.value.size - sizeof(LV2_Atom_Vector_Body)) / sizeof(int32_t);
+
+	return LV2_ATOM_CONTENTS_CONST(LV2_Atom_Vector_Body, &delta->vec);
+}
+
+static inline int
+chimaera_delta_check_type(const chimaera_forge_t *cforge, const LV2_Atom *atom)
+{
+	const LV2_Atom_Forge *forge = &cforge->forge;
+	const LV2_Atom_Object *obj = ASSUME_ALIGNED(atom);
+
+	if(lv2_atom_forge_is_object_type(forge, obj->atom.type)
+			&& (obj->body.otype == cforge->uris.delta) )
+		return 1;
+	
+	return 0;
+}
+
+static inline void
+chimaera_delta_apply(int32_t *values, uint32_t sensors, const int32_t *runs,
+	uint32_t n)
+{
+	for(uint32_t i=0; i+2<=n; )
+	{
+		const uint32_t idx = runs[i++];
+		const uint32_t cnt = runs[i++];
+
+		// runs are untrusted, idx + j may wrap around
+		for(uint32_t j=0; (j<cnt) && (i<n); j++, i++)
+		{
+			if( (idx < sensors) && (j < sensors - idx) )
+				values[idx + j] = runs[i];
+		}
+	}
+}
+
+// shared memory dump channel announcement, carries the segment name
+static inline LV2_Atom_Forge_Ref
+chimaera_shm_forge(chimaera_forge_t *cforge, const char *name)
+{
+	LV2_Atom_Forge *forge = &cforge->forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+
+	ref = lv2_atom_forge_object(forge, &frame, 0, cforge->uris.shm);
+	if(ref)
+		ref = lv2_atom_forge_key(forge, cforge->uris.shm);
+	if(ref)
+		ref = lv2_atom_forge_string(forge, name, strlen(name));
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame);
+
+	return ref;
+}
+
+static inline const char *
+chimaera_shm_deforge(const chimaera_forge_t *cforge, const LV2_Atom *atom)
+{
+	const LV2_Atom_Forge *forge = &cforge->forge;
+	const LV2_Atom_Object *obj = ASSUME_ALIGNED(atom);
+
+	LV2_ATOM_OBJECT_FOREACH(obj, prop)
+	{
+		if( (prop->key == cforge->uris.shm) && (prop->value.type == forge->String) )
+			return LV2_ATOM_BODY_CONST(&prop->value);
+	}
+
+	return NULL;
+}
+
+static inline int
+chimaera_shm_check_type(const chimaera_forge_t *cforge, const LV2_Atom *atom)
+{
+	const LV2_Atom_Forge *forge = &cforge->forge;
+	const LV2_Atom_Object *obj = ASSUME_ALIGNED(atom);
+
+	if(lv2_atom_forge_is_object_type(forge, obj->atom.type)
+			&& (obj->body.otype == cforge->uris.shm) )
+		return 1;
+	
+	return 0;
+}
+
+// latency tag handle
+static inline uint64_t
+chimaera_latency_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline LV2_Atom_Forge_Ref
+chimaera_latency_forge(chimaera_forge_t *cforge, const chimaera_latency_t *lat)
+{
+	LV2_Atom_Forge *forge = &cforge->forge;
+	const uint32_t otype = cforge->uris.latency;
+
+	const chimaera_latency_pack_t pack = {
+		.cobj = {
+			.obj = {
+				.atom.type = forge->Object,
+				.atom.size = sizeof(chimaera_latency_pack_t) - sizeof(LV2_Atom),
+				.body.id = 0,
+				.body.otype = otype
+			},
+			.prop = {
+				.key = otype,
+				.context = 0,
+				.value.type = forge->Tuple,
+				.value.size = sizeof(chimaera_latency_pack_t) - sizeof(LV2_Atom_Object) - sizeof(LV2_Atom_Property_Body)
+			}
+		},
+		.arrival = {
+			.atom.size = sizeof(int64_t),
+			.atom.type = forge->Long,
+			.body = lat->arrival
+		},
+		.dispatch = {
+			.atom.size = sizeof(int64_t),
+			.atom.type = forge->Long,
+			.body = lat->dispatch
+		},
+		.timetag = {
+			.atom.size = sizeof(int64_t),
+			.atom.type = forge->Long,
+			.body = lat->timetag
+		}
+	};
+
+	return lv2_atom_forge_raw(forge, &pack, sizeof(chimaera_latency_pack_t));
+}
+
+static inline int
+chimaera_latency_check_type(const chimaera_forge_t *cforge, const LV2_Atom *atom)
+{
+	const LV2_Atom_Forge *forge = &cforge->forge;
+	const LV2_Atom_Object *obj = ASSUME_ALIGNED(atom);
+
+	if(lv2_atom_forge_is_object_type(forge, obj->atom.type)
+			&& (obj->body.otype == cforge->uris.latency) )
+		return 1;
+
+	return 0;
+}
+
+static inline void
+chimaera_latency_deforge(const chimaera_forge_t *cforge, const LV2_Atom *atom,
+	chimaera_latency_t *lat)
+{
+	const chimaera_latency_pack_t *pack = ASSUME_ALIGNED(atom);
+
+	lat->arrival = pack->arrival.body;
+	lat->dispatch = pack->dispatch.body;
+	lat->timetag = pack->timetag.body;
+}
+
+static inline void
+chimaera_latency_stats_add(chimaera_latency_stats_t *stats,
+	const chimaera_latency_t *lat, uint64_t now)
+{
+	const uint64_t total = now > lat->arrival ? now - lat->arrival : 0;
+
+	stats->n++;
+	stats->quant += lat->dispatch > lat->arrival ? lat->dispatch - lat->arrival : 0;
+	stats->chain += now > lat->dispatch ? now - lat->dispatch : 0;
+	if(total > stats->max)
+		stats->max = total;
+}
+
+// writes means and maximum in ms to the given optional ports and resets,
+// ports hold their values over blocks without tags
+static inline void
+chimaera_latency_stats_report(chimaera_latency_stats_t *stats,
+	float *quant, float *chain, float *max)
+{
+	if(!stats->n)
+		return;
+
+	if(quant)
+		*quant = stats->quant * 1e-6f / stats->n;
+	if(chain)
+		*chain = stats->chain * 1e-6f / stats->n;
+	if(max)
+		*max = stats->max * 1e-6f;
+
+	stats->n = 0;
+	stats->quant = 0;
+	stats->chain = 0;
+	stats->max = 0;
+}
+
 // event handle 
 static inline LV2_Atom_Forge_Ref
 chimaera_event_forge(chimaera_forge_t *cforge, const chimaera_event_t *ev)
@@ -408,6 +704,7 @@ chimaera_dict_add(chimaera_dict_t *dict, uint32_t sid)
 			return dict[i].ref;
 		}
 
+	CHIMAERA_PROBE1(dict_full, sid);
 	return NULL;
 }
 
@@ -434,4 +731,64 @@ chimaera_dict_ref(chimaera_dict_t *dict, uint32_t sid)
 	return NULL;
 }
 
+// per-instance memory pool, reserved at instantiate, so runtime-sized
+// buffers can grow in run() with O(1) allocation and without malloc
+#if !defined(CHIMAERA_POOL_SIZE)
+#	define CHIMAERA_POOL_SIZE 0x10000 // 64K
+#endif
+
+// non-rt
+static inline int
+chimaera_pool_init(chimaera_pool_t *pool, size_t size)
+{
+	const size_t total = tlsf_size() + tlsf_pool_overhead() + size;
+
+	pool->area = malloc(total);
+	if(!pool->area)
+		return -1;
+
+	memset(pool->area, 0x0, total); // prefault pages
+	pool->tlsf = tlsf_create_with_pool(pool->area, total);
+	if(!pool->tlsf)
+	{
+		free(pool->area);
+		pool->area = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+// non-rt, releases all buffers allocated from the pool
+static inline void
+chimaera_pool_deinit(chimaera_pool_t *pool)
+{
+	if(pool->tlsf)
+		tlsf_destroy(pool->tlsf);
+	if(pool->area)
+		free(pool->area);
+
+	pool->tlsf = NULL;
+	pool->area = NULL;
+}
+
+// rt, makes room for n elements of given size in *ptr, which keeps its
+// contents and old capacity when the pool is exhausted
+static inline int
+chimaera_pool_reserve(chimaera_pool_t *pool, void **ptr, uint32_t *cap,
+	uint32_t n, size_t size)
+{
+	if(n <= *cap)
+		return 0;
+
+	void *dst = tlsf_realloc(pool->tlsf, *ptr, n * size);
+	if(!dst)
+		return -1;
+
+	*ptr = dst;
+	*cap = n;
+
+	return 0;
+}
+
 #endif // _CHIMAERA_LV2_H
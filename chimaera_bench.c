@@ -0,0 +1,899 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// host-free micro-benchmark of the plugin descriptors, feeds generated event
+// and dump streams into each plugin and prints one CSV line per run
+//
+// In check mode (-x), run() is additionally armed against the rtcheck
+// interposer, which must be preloaded, and each run is repeated with an output
+// capacity small enough to overflow the plugin's forge. Any non-realtime-safe
+// call from within run() fails the check.
+//
+// Jobs scheduled by a plugin are worked off synchronously after each run(),
+// outside of the armed window, their responses are delivered inside of it.
+// The recorder writes to CAPTURE_PATH, which the player then replays.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <endian.h>
+#include <dlfcn.h>
+
+#include <chimaera.h>
+#include <lv2_osc.h>
+
+#include <lv2/lv2plug.in/ns/ext/log/log.h>
+#include <lv2/lv2plug.in/ns/ext/patch/patch.h>
+
+#define URID_MAX 512
+#define PORT_MAX 80
+#define JOB_MAX 64 // scheduled jobs or responses per period
+#define JOB_SIZE 4096
+#define CAPTURE_PATH "/tmp/chimaera_bench.cap"
+#define BUF_SIZE 0x40000 // per port
+#define SENSORS 128
+#define SENSOR_RATE 2000 // sensor frames per second
+#define CHURN_RATE 4 // blob releases and re-touches per second
+#define CAPACITY_MIN 128 // output capacity of the overflow pass
+
+typedef enum _stim_t stim_t;
+typedef enum _mix_t mix_t;
+typedef struct _bench_t bench_t;
+typedef struct _urid_t urid_t;
+typedef struct _job_queue_t job_queue_t;
+typedef struct _host_t host_t;
+
+enum _stim_t {
+	STIM_CHIMAERA	= 0, // chimaera events and dumps
+	STIM_OSC			= 1 // dummy protocol as sent by the device
+};
+
+enum _mix_t {
+	MIX_EVENTS	= 0,
+	MIX_DUMPS		= 1, // events plus one dump per sensor frame
+	MIX_TUIO2		= 2, // tuio2 bundles with lost and late frames, STIM_OSC only
+	MIX_MAX
+};
+
+// port kinds: e: stimulus input, a: empty atom input, o: atom output,
+// c: control input, x: control or cv output
+struct _bench_t {
+	const char *name;
+	const char *uri;
+	stim_t stim;
+	const char *ports;
+	float defaults [PORT_MAX];
+	const char *path; // property set to CAPTURE_PATH on the first period
+};
+
+struct _urid_t {
+	char *uri;
+};
+
+struct _job_queue_t {
+	unsigned n;
+	uint32_t size [JOB_MAX];
+	uint8_t body [JOB_MAX][JOB_SIZE];
+};
+
+struct _host_t {
+	urid_t urids [URID_MAX];
+	unsigned n_urids;
+	LV2_URID_Map map;
+
+	chimaera_forge_t cforge;
+	osc_forge_t oforge;
+
+	uint32_t rate;
+	double seconds;
+	uint32_t fid;
+	int32_t values [SENSORS];
+
+	LV2_Log_Log log;
+	unsigned logs;
+	LV2_URID patch_Get;
+	LV2_URID patch_Set;
+	LV2_URID patch_property;
+	LV2_URID patch_value;
+
+	LV2_Worker_Schedule sched;
+	job_queue_t jobs;
+	job_queue_t responses;
+
+	int check;
+	unsigned failed;
+	void (*rtcheck_arm)(int state);
+	unsigned (*rtcheck_violations)(void);
+	const char *(*rtcheck_first)(void);
+	void (*rtcheck_reset)(void);
+};
+
+#define VOICE_PORTS "xxxxxxxx" // gate, sid, north, south, x, z, X, Z
+
+static const bench_t benches [] = {
+	{
+		.name = "filter", .uri = CHIMAERA_FILTER_URI, .stim = STIM_CHIMAERA,
+		.ports = "eoccccccc",
+		.defaults = {[2] = 255, [3] = 1, [4] = 1, [5] = 1, [6] = 1, [7] = 1, [8] = 1}
+	},
+	{
+		.name = "mapper", .uri = CHIMAERA_MAPPER_URI, .stim = STIM_CHIMAERA,
+		.ports = "eocc",
+		.defaults = {[2] = SENSORS, [3] = 1}
+	},
+	{
+		.name = "mogrifier", .uri = CHIMAERA_MOGRIFIER_URI, .stim = STIM_CHIMAERA,
+		.ports = "eocccc",
+		.defaults = {[2] = 1, [4] = 1}
+	},
+	{
+		.name = "driver", .uri = CHIMAERA_DRIVER_URI, .stim = STIM_OSC,
+		.ports = "eo"
+	},
+	{
+		.name = "midi_out", .uri = CHIMAERA_MIDI_OUT_URI, .stim = STIM_CHIMAERA,
+		.ports = "eoccccccc",
+		.defaults = {[2] = SENSORS, [4] = 2, [5] = 7}
+	},
+	{
+		.name = "mpe_out/legacy", .uri = CHIMAERA_MPE_OUT_URI, .stim = STIM_CHIMAERA,
+		.ports = "eocccccc",
+		.defaults = {[2] = SENSORS, [3] = 2, [4] = 2, [6] = 0}
+	},
+	{
+		.name = "mpe_out/mpe", .uri = CHIMAERA_MPE_OUT_URI, .stim = STIM_CHIMAERA,
+		.ports = "eocccccc",
+		.defaults = {[2] = SENSORS, [3] = 2, [4] = 2, [6] = 1}
+	},
+	{
+		.name = "mpe_out/ump", .uri = CHIMAERA_MPE_OUT_URI, .stim = STIM_CHIMAERA,
+		.ports = "eocccccc",
+		.defaults = {[2] = SENSORS, [3] = 2, [4] = 2, [6] = 2}
+	},
+	{
+		.name = "osc_out", .uri = CHIMAERA_OSC_OUT_URI, .stim = STIM_CHIMAERA,
+		.ports = "eoccccccccccccca",
+		.defaults = {[3] = 100, [4] = 200, [5] = 100, [7] = 1, [8] = 1, [11] = 10,
+			[14] = 1000}
+	},
+	{
+		.name = "osc_out/bundle", .uri = CHIMAERA_OSC_OUT_URI, .stim = STIM_CHIMAERA,
+		.ports = "eoccccccccccccca",
+		.defaults = {[3] = 100, [4] = 200, [5] = 100, [7] = 1, [8] = 1, [10] = 1,
+			[11] = 10, [12] = 1, [14] = 1000}
+	},
+	{
+		.name = "control_out", .uri = CHIMAERA_CONTROL_OUT_URI, .stim = STIM_CHIMAERA,
+		.ports = "eoxxxxxxxxccxxxxx",
+		.defaults = {[11] = 1}
+	},
+	{
+		.name = "poly_out", .uri = CHIMAERA_POLY_OUT_URI, .stim = STIM_CHIMAERA,
+		.ports = "eo" VOICE_PORTS VOICE_PORTS VOICE_PORTS VOICE_PORTS
+			VOICE_PORTS VOICE_PORTS VOICE_PORTS VOICE_PORTS
+	},
+	{
+		.name = "visualizer", .uri = CHIMAERA_VISUALIZER_URI, .stim = STIM_CHIMAERA,
+		.ports = "eoccocc",
+		.defaults = {[2] = SENSORS, [3] = 30}
+	},
+	{
+		.name = "simulator", .uri = CHIMAERA_SIMULATOR_URI, .stim = STIM_CHIMAERA,
+		.ports = "eoccccccc",
+		.defaults = {[2] = SENSORS, [3] = 1, [4] = 16, [5] = 1000, [6] = 3, [7] = 1,
+			[8] = 1}
+	},
+	{
+		.name = "recorder", .uri = CHIMAERA_RECORDER_URI, .stim = STIM_CHIMAERA,
+		.ports = "eoc",
+		.defaults = {[2] = 1},
+		.path = CHIMAERA_URI"#recorder_path"
+	},
+	{
+		.name = "player", .uri = CHIMAERA_PLAYER_URI, .stim = STIM_CHIMAERA,
+		.ports = "eocc",
+		.defaults = {[2] = 1, [3] = 1},
+		.path = CHIMAERA_URI"#player_path"
+	},
+	{
+		.name = NULL
+	}
+};
+
+static const unsigned blob_counts [] = {1, 16, 64, 0};
+static const unsigned block_sizes [] = {64, 256, 1024, 0};
+static const char *mix_names [MIX_MAX] = {"events", "dumps", "tuio2"};
+
+static LV2_URID
+_map(LV2_URID_Map_Handle instance, const char *uri)
+{
+	host_t *host = instance;
+
+	for(unsigned i=0; i<host->n_urids; i++)
+	{
+		if(!strcmp(host->urids[i].uri, uri))
+			return i + 1;
+	}
+
+	if(host->n_urids >= URID_MAX)
+		return 0;
+
+	host->urids[host->n_urids].uri = strdup(uri);
+
+	return ++host->n_urids;
+}
+
+// only counts, as a realtime-safe host log would enqueue without formatting
+static int
+_log_vprintf(LV2_Log_Handle instance, LV2_URID type, const char *fmt,
+	va_list args)
+{
+	host_t *host = instance;
+
+	host->logs++;
+
+	return 0;
+}
+
+static int
+_log_printf(LV2_Log_Handle instance, LV2_URID type, const char *fmt, ...)
+{
+	host_t *host = instance;
+
+	host->logs++;
+
+	return 0;
+}
+
+// realtime-safe, copies the job into the queue worked off after run()
+static LV2_Worker_Status
+_job_push(job_queue_t *queue, uint32_t size, const void *data)
+{
+	if( (queue->n >= JOB_MAX) || (size > JOB_SIZE) )
+		return LV2_WORKER_ERR_NO_SPACE;
+
+	queue->size[queue->n] = size;
+	memcpy(queue->body[queue->n], data, size);
+	queue->n++;
+
+	return LV2_WORKER_SUCCESS;
+}
+
+static LV2_Worker_Status
+_schedule_work(LV2_Worker_Schedule_Handle instance, uint32_t size,
+	const void *data)
+{
+	host_t *host = instance;
+
+	return _job_push(&host->jobs, size, data);
+}
+
+static LV2_Worker_Status
+_respond(LV2_Worker_Respond_Handle instance, uint32_t size, const void *data)
+{
+	host_t *host = instance;
+
+	return _job_push(&host->responses, size, data);
+}
+
+// works off the jobs of the last run() as a worker thread would, then delivers
+// the responses as the audio thread would, the latter armed in check mode
+static void
+_worker_run(host_t *host, LV2_Handle instance, const LV2_Worker_Interface *iface)
+{
+	for(unsigned i=0; i<host->jobs.n; i++)
+		iface->work(instance, _respond, host, host->jobs.size[i], host->jobs.body[i]);
+	host->jobs.n = 0;
+
+	if(host->check)
+		host->rtcheck_arm(1);
+	for(unsigned i=0; i<host->responses.n; i++)
+		iface->work_response(instance, host->responses.size[i], host->responses.body[i]);
+	if(iface->end_run)
+		iface->end_run(instance);
+	if(host->check)
+		host->rtcheck_arm(0);
+	host->responses.n = 0;
+}
+
+static inline uint64_t
+_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const LV2_Descriptor *
+_descriptor(const char *uri)
+{
+	const LV2_Descriptor *desc;
+
+	for(uint32_t i=0; (desc = lv2_descriptor(i)); i++)
+	{
+		if(!strcmp(desc->URI, uri))
+			return desc;
+	}
+
+	return NULL;
+}
+
+// deterministic blob trajectory
+static void
+_blob(unsigned i, uint64_t f, float *x, float *z)
+{
+	const float t = (float)f / SENSOR_RATE;
+
+	*x = fmodf(0.05f + 0.9f*i/64 + 0.01f*sinf(t + i), 1.f);
+	*z = 0.5f + 0.4f*sinf(2.f*M_PI*0.5f*t + i);
+}
+
+static void
+_dump_fill(host_t *host, unsigned blobs, uint64_t f)
+{
+	memset(host->values, 0x0, sizeof(host->values));
+
+	for(unsigned i=0; i<blobs; i++)
+	{
+		float x, z;
+		_blob(i, f, &x, &z);
+
+		const int c = x * (SENSORS - 1);
+		const int32_t amp = (i & 1 ? 1 : -1) * z * 0x7ff;
+
+		for(int k=-2; k<=2; k++)
+		{
+			if( (c + k >= 0) && (c + k < SENSORS) )
+				host->values[c + k] += amp / (1 + k*k);
+		}
+	}
+}
+
+static LV2_Atom_Forge_Ref
+_event(host_t *host, stim_t stim, int64_t frames, chimaera_state_t state,
+	unsigned i, uint32_t sid, float x, float z, LV2_Atom_Forge_Ref ref)
+{
+	LV2_Atom_Forge *forge = &host->cforge.forge;
+	const uint32_t pid = i & 1 ? 0x80 : 0x100;
+
+	if(ref)
+		ref = lv2_atom_forge_frame_time(forge, frames);
+	if(!ref)
+		return ref;
+
+	if(stim == STIM_OSC)
+	{
+		switch(state)
+		{
+			case CHIMAERA_STATE_ON:
+				return osc_forge_message_vararg(&host->oforge, forge, "/on", "iiiff",
+					sid, 0, pid, x, z);
+			case CHIMAERA_STATE_SET:
+				return osc_forge_message_vararg(&host->oforge, forge, "/set", "iff",
+					sid, x, z);
+			case CHIMAERA_STATE_OFF:
+				return osc_forge_message_vararg(&host->oforge, forge, "/off", "i",
+					sid);
+			case CHIMAERA_STATE_IDLE:
+				return osc_forge_message_vararg(&host->oforge, forge, "/idle", "");
+		}
+	}
+
+	const chimaera_event_t cev = {
+		.state = state,
+		.sid = sid,
+		.gid = 0,
+		.pid = pid,
+		.x = x,
+		.z = z
+	};
+
+	return chimaera_event_forge(&host->cforge, &cev);
+}
+
+static LV2_Atom_Forge_Ref
+_dump(host_t *host, stim_t stim, int64_t frames, LV2_Atom_Forge_Ref ref)
+{
+	LV2_Atom_Forge *forge = &host->cforge.forge;
+
+	if(ref)
+		ref = lv2_atom_forge_frame_time(forge, frames);
+	if(!ref)
+		return ref;
+
+	if(stim == STIM_OSC)
+	{
+		uint16_t payload [SENSORS];
+		for(unsigned j=0; j<SENSORS; j++)
+			payload[j] = htobe16(host->values[j]);
+
+		return osc_forge_message_vararg(&host->oforge, forge, "/dump", "ib",
+			host->fid++, (uint32_t)sizeof(payload), (const uint8_t *)payload);
+	}
+
+	return chimaera_dump_forge(&host->cforge, host->values, SENSORS);
+}
+
+static LV2_Atom_Forge_Ref
+_tuio2(host_t *host, int64_t frames, unsigned blobs, const uint32_t *sids,
+	uint64_t f, LV2_Atom_Forge_Ref ref)
+{
+	LV2_Atom_Forge *forge = &host->cforge.forge;
+	LV2_Atom_Forge_Frame bndl [2];
+	LV2_Atom_Forge_Frame msg [2];
+	char fmt [64 + 1];
+	uint32_t fid = ++host->fid;
+	uint64_t stamp = f << 20;
+
+	if(f % 100 == 99)
+		fid = ++host->fid; // previous frame lost
+	else if(f % 100 == 50)
+		fid -= 2; // late frame
+	if(f % 250 == 249)
+		stamp = 0; // time warp
+
+	if(ref)
+		ref = lv2_atom_forge_frame_time(forge, frames);
+	if(ref)
+		ref = osc_forge_bundle_push(&host->oforge, forge, bndl, 1);
+	if(ref)
+		ref = osc_forge_message_vararg(&host->oforge, forge, "/tuio2/frm", "itis",
+			fid, stamp, (SENSORS << 16) | 1, "bench");
+
+	for(unsigned i=0; i<blobs; i++)
+	{
+		float x, z;
+		_blob(i, f, &x, &z);
+
+		if(ref)
+			ref = osc_forge_message_vararg(&host->oforge, forge, "/tuio2/tok", "iiifff",
+				sids[i], i & 1 ? 0x80 : 0x100, 0, x, z, 0.f);
+	}
+
+	memset(fmt, 'i', blobs);
+	fmt[blobs] = '\0';
+	if(ref)
+		ref = osc_forge_message_push(&host->oforge, forge, msg, "/tuio2/alv", fmt);
+	for(unsigned i=0; i<blobs; i++)
+	{
+		if(ref)
+			ref = osc_forge_int32(&host->oforge, forge, sids[i]);
+	}
+	if(ref)
+		osc_forge_message_pop(&host->oforge, forge, msg);
+
+	if(ref)
+		osc_forge_bundle_pop(&host->oforge, forge, bndl);
+
+	return ref;
+}
+
+// forges all sensor frames due in [start, start + nsamples), returns number
+// of input events
+static unsigned
+_stimulus(host_t *host, const bench_t *bench, mix_t mix, unsigned blobs,
+	uint32_t *sids, uint64_t *f, uint64_t start, uint32_t nsamples,
+	LV2_Atom_Sequence *seq)
+{
+	const stim_t stim = bench->stim;
+	LV2_Atom_Forge *forge = &host->cforge.forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+	unsigned n = 0;
+
+	lv2_atom_forge_set_buffer(forge, (uint8_t *)seq, BUF_SIZE);
+	ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	if(bench->path && (start == 0) )
+	{
+		LV2_Atom_Forge_Frame obj;
+
+		if(ref)
+			ref = lv2_atom_forge_frame_time(forge, 0);
+		if(ref)
+			ref = lv2_atom_forge_object(forge, &obj, 0, host->patch_Set);
+		if(ref)
+			ref = lv2_atom_forge_key(forge, host->patch_property);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, host->map.map(host->map.handle, bench->path));
+		if(ref)
+			ref = lv2_atom_forge_key(forge, host->patch_value);
+		if(ref)
+			ref = lv2_atom_forge_path(forge, CAPTURE_PATH, strlen(CAPTURE_PATH));
+		if(ref)
+			lv2_atom_forge_pop(forge, &obj);
+	}
+
+	if(host->check) // to be ignored or answered by the plugin
+	{
+		LV2_Atom_Forge_Frame obj;
+
+		if(ref)
+			ref = lv2_atom_forge_frame_time(forge, 0);
+		if(ref)
+			ref = lv2_atom_forge_object(forge, &obj, 0, host->patch_Get);
+		if(ref)
+			lv2_atom_forge_pop(forge, &obj);
+	}
+
+	for( ; ; (*f)++)
+	{
+		const uint64_t abs = *f * host->rate / SENSOR_RATE;
+		if(abs >= start + nsamples)
+			break;
+		const int64_t frames = abs - start;
+
+		// one blob after the other is released and touched again
+		const unsigned churn = *f % (SENSOR_RATE / CHURN_RATE)
+			? blobs
+			: (*f / (SENSOR_RATE / CHURN_RATE)) % blobs;
+
+		// all blobs are released once per second
+		const int idle = *f % SENSOR_RATE == SENSOR_RATE - 1;
+
+		if(mix == MIX_TUIO2)
+		{
+			for(unsigned i=0; i<blobs; i++)
+			{
+				if(idle)
+					sids[i] = 0;
+				else if( (i == churn) || !sids[i])
+					sids[i] = 1 + *f * 64 + i;
+			}
+
+			ref = _tuio2(host, frames, idle ? 0 : blobs, sids, *f, ref);
+			n += idle ? 1 : blobs;
+			continue;
+		}
+
+		if(idle)
+		{
+			for(unsigned i=0; i<blobs; i++)
+			{
+				if(!sids[i])
+					continue;
+
+				ref = _event(host, stim, frames, CHIMAERA_STATE_OFF, i, sids[i], 0.f, 0.f, ref);
+				sids[i] = 0;
+				n++;
+			}
+
+			ref = _event(host, stim, frames, CHIMAERA_STATE_IDLE, 0, 0, 0.f, 0.f, ref);
+			n++;
+			continue;
+		}
+
+		for(unsigned i=0; i<blobs; i++)
+		{
+			float x, z;
+			_blob(i, *f, &x, &z);
+
+			if( (i == churn) && sids[i])
+			{
+				ref = _event(host, stim, frames, CHIMAERA_STATE_OFF, i, sids[i], x, z, ref);
+				sids[i] = 0;
+				n++;
+			}
+
+			if(!sids[i])
+			{
+				sids[i] = 1 + *f * 64 + i;
+				ref = _event(host, stim, frames, CHIMAERA_STATE_ON, i, sids[i], x, z, ref);
+			}
+			else
+			{
+				ref = _event(host, stim, frames, CHIMAERA_STATE_SET, i, sids[i], x, z, ref);
+			}
+			n++;
+		}
+
+		if(mix == MIX_DUMPS)
+		{
+			_dump_fill(host, blobs, *f);
+			ref = _dump(host, stim, frames, ref);
+			n++;
+		}
+	}
+
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame);
+	else
+		fprintf(stderr, "stimulus buffer overflow\n");
+
+	return n;
+}
+
+static int
+_run(host_t *host, const bench_t *bench, unsigned blobs, uint32_t block, mix_t mix,
+	uint32_t capacity)
+{
+	const LV2_Descriptor *desc = _descriptor(bench->uri);
+	if(!desc)
+	{
+		fprintf(stderr, "%s: descriptor not found\n", bench->uri);
+		return -1;
+	}
+
+	const LV2_Feature map_feature = {
+		.URI = LV2_URID__map,
+		.data = &host->map
+	};
+	const LV2_Feature log_feature = {
+		.URI = LV2_LOG__log,
+		.data = &host->log
+	};
+	const LV2_Feature sched_feature = {
+		.URI = LV2_WORKER__schedule,
+		.data = &host->sched
+	};
+	const LV2_Feature *const features [] = {
+		&map_feature,
+		&log_feature,
+		&sched_feature,
+		NULL
+	};
+
+	LV2_Handle instance = desc->instantiate(desc, host->rate, "", features);
+	if(!instance)
+	{
+		fprintf(stderr, "%s: instantiation failed\n", bench->uri);
+		return -1;
+	}
+
+	const LV2_Worker_Interface *work_iface = desc->extension_data
+		? desc->extension_data(LV2_WORKER__interface)
+		: NULL;
+	host->jobs.n = 0;
+	host->responses.n = 0;
+
+	const unsigned n_ports = strlen(bench->ports);
+	void *bufs [PORT_MAX];
+	for(unsigned p=0; p<n_ports; p++)
+	{
+		bufs[p] = aligned_alloc(64, BUF_SIZE);
+		memset(bufs[p], 0x0, BUF_SIZE);
+
+		switch(bench->ports[p])
+		{
+			case 'a':
+			{
+				LV2_Atom_Sequence *seq = bufs[p];
+				seq->atom.type = host->cforge.forge.Sequence;
+				seq->atom.size = sizeof(LV2_Atom_Sequence_Body);
+				break;
+			}
+			case 'c':
+			{
+				*(float *)bufs[p] = bench->defaults[p];
+				break;
+			}
+		}
+
+		desc->connect_port(instance, p, bufs[p]);
+	}
+
+	if(desc->activate)
+		desc->activate(instance);
+
+	uint32_t sids [64] = {0};
+	const uint64_t total = host->seconds * host->rate;
+	uint64_t f = 0;
+	uint64_t events = 0;
+	uint64_t out_bytes = 0;
+	uint64_t ns = 0;
+
+	host->logs = 0;
+	if(host->check)
+		host->rtcheck_reset();
+
+	for(uint64_t start=0; start<total; start+=block)
+	{
+		for(unsigned p=0; p<n_ports; p++)
+		{
+			switch(bench->ports[p])
+			{
+				case 'e':
+				{
+					events += _stimulus(host, bench, mix, blobs, sids, &f, start, block,
+						bufs[p]);
+					break;
+				}
+				case 'o':
+				{
+					LV2_Atom_Sequence *seq = bufs[p];
+					seq->atom.type = 0;
+					seq->atom.size = capacity - sizeof(LV2_Atom);
+					break;
+				}
+			}
+		}
+
+		if(host->check)
+			host->rtcheck_arm(1);
+		const uint64_t t0 = _now();
+		desc->run(instance, block);
+		ns += _now() - t0;
+		if(host->check)
+			host->rtcheck_arm(0);
+
+		if(work_iface)
+			_worker_run(host, instance, work_iface);
+
+		for(unsigned p=0; p<n_ports; p++)
+		{
+			if(bench->ports[p] == 'o')
+			{
+				const LV2_Atom_Sequence *seq = bufs[p];
+				out_bytes += seq->atom.size - sizeof(LV2_Atom_Sequence_Body);
+			}
+		}
+	}
+
+	if(desc->deactivate)
+		desc->deactivate(instance);
+	if(work_iface) // e.g. last chunk of the recorder
+		_worker_run(host, instance, work_iface);
+	desc->cleanup(instance);
+
+	for(unsigned p=0; p<n_ports; p++)
+		free(bufs[p]);
+
+	if(host->check)
+	{
+		const unsigned violations = host->rtcheck_violations();
+		const char *first = host->rtcheck_first();
+
+		printf("%s,%u,%"PRIu32",%s,%"PRIu32",%u,%u,%s\n",
+			bench->name, blobs, block, mix_names[mix], capacity,
+			host->logs, violations, first ? first : "");
+		if(violations)
+			host->failed++;
+	}
+	else
+	{
+		printf("%s,%u,%"PRIu32",%s,%"PRIu64",%"PRIu64",%.1f,%.0f,%"PRIu64",%.1f\n",
+			bench->name, blobs, block, mix_names[mix],
+			events, ns,
+			events ? (double)ns / events : 0.0,
+			ns ? events * 1e9 / ns : 0.0,
+			out_bytes,
+			events ? (double)out_bytes / events : 0.0);
+	}
+	fflush(stdout);
+
+	return 0;
+}
+
+static void
+_usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-p PLUGIN] [-d SECONDS] [-r RATE] [-x] [-l]\n"
+		"  -p  only run benches whose name starts with PLUGIN\n"
+		"  -d  duration of signal per run (default 2 s)\n"
+		"  -r  sample rate (default 48000 Hz)\n"
+		"  -x  check realtime safety, needs LD_PRELOAD=chimaera_rtcheck.so\n"
+		"  -l  list benches\n", name);
+}
+
+int
+main(int argc, char **argv)
+{
+	static host_t host;
+	const char *only = NULL;
+	int c;
+
+	host.rate = 48000;
+	host.seconds = 2.0;
+
+	while( (c = getopt(argc, argv, "p:d:r:xlh")) != -1)
+	{
+		switch(c)
+		{
+			case 'p':
+				only = optarg;
+				break;
+			case 'd':
+				host.seconds = atof(optarg);
+				break;
+			case 'r':
+				host.rate = atoi(optarg);
+				break;
+			case 'x':
+				host.check = 1;
+				break;
+			case 'l':
+				for(const bench_t *bench = benches; bench->name; bench++)
+					printf("%s\n", bench->name);
+				return 0;
+			default:
+				_usage(argv[0]);
+				return -1;
+		}
+	}
+
+	if( (host.rate < SENSOR_RATE) || (host.seconds <= 0.0) )
+	{
+		_usage(argv[0]);
+		return -1;
+	}
+
+	if(host.check)
+	{
+		host.rtcheck_arm = dlsym(RTLD_DEFAULT, "rtcheck_arm");
+		host.rtcheck_violations = dlsym(RTLD_DEFAULT, "rtcheck_violations");
+		host.rtcheck_first = dlsym(RTLD_DEFAULT, "rtcheck_first");
+		host.rtcheck_reset = dlsym(RTLD_DEFAULT, "rtcheck_reset");
+
+		if(!host.rtcheck_arm || !host.rtcheck_violations || !host.rtcheck_first
+			|| !host.rtcheck_reset)
+		{
+			fprintf(stderr, "%s: rtcheck interposer not preloaded\n", argv[0]);
+			return -1;
+		}
+	}
+
+	host.map.handle = &host;
+	host.map.map = _map;
+	host.log.handle = &host;
+	host.log.printf = _log_printf;
+	host.log.vprintf = _log_vprintf;
+	host.patch_Get = _map(&host, LV2_PATCH__Get);
+	host.patch_Set = _map(&host, LV2_PATCH__Set);
+	host.patch_property = _map(&host, LV2_PATCH__property);
+	host.patch_value = _map(&host, LV2_PATCH__value);
+	host.sched.handle = &host;
+	host.sched.schedule_work = _schedule_work;
+	chimaera_forge_init(&host.cforge, &host.map);
+	osc_forge_init(&host.oforge, &host.map);
+
+	if(host.check)
+		printf("plugin,blobs,block,mix,capacity,logs,violations,first\n");
+	else
+		printf("plugin,blobs,block,mix,events,ns,ns_per_event,events_per_s,out_bytes,out_bytes_per_event\n");
+
+	for(const bench_t *bench = benches; bench->name; bench++)
+	{
+		if(only && strncmp(bench->name, only, strlen(only)))
+			continue;
+
+		for(const unsigned *blobs = blob_counts; *blobs; blobs++)
+			for(const unsigned *block = block_sizes; *block; block++)
+				for(mix_t mix = 0; mix < MIX_MAX; mix++)
+				{
+					if( (mix == MIX_TUIO2) && (bench->stim != STIM_OSC) )
+						continue;
+
+					_run(&host, bench, *blobs, *block, mix, BUF_SIZE);
+					if(host.check)
+						_run(&host, bench, *blobs, *block, mix, CAPACITY_MIN);
+				}
+	}
+
+	for(unsigned i=0; i<host.n_urids; i++)
+		free(host.urids[i].uri);
+
+	if(host.failed)
+		fprintf(stderr, "%u runs not realtime-safe\n", host.failed);
+
+	return host.failed ? -1 : 0;
+}
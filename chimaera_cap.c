@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// reads a capture written by the recorder plugin and prints its records or
+// a summary of it
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <capture.h>
+
+#define SENSOR_MAX 160
+
+static const char *
+_state_name(uint8_t state)
+{
+	switch(state)
+	{
+		case CHIMAERA_STATE_ON:
+			return "on";
+		case CHIMAERA_STATE_SET:
+			return "set";
+		case CHIMAERA_STATE_OFF:
+			return "off";
+		case CHIMAERA_STATE_IDLE:
+			return "idle";
+		default:
+			return "?";
+	}
+}
+
+static void
+_usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-s] FILE\n"
+		"  -s  print summary only\n", name);
+}
+
+int
+main(int argc, char **argv)
+{
+	int summary = 0;
+	int c;
+
+	while( (c = getopt(argc, argv, "sh")) != -1)
+	{
+		switch(c)
+		{
+			case 's':
+				summary = 1;
+				break;
+			default:
+				_usage(argv[0]);
+				return -1;
+		}
+	}
+
+	if(optind >= argc)
+	{
+		_usage(argv[0]);
+		return -1;
+	}
+
+	const char *path = argv[optind];
+	const int fd = open(path, O_RDONLY);
+	if(fd < 0)
+	{
+		perror(path);
+		return -1;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) || (st.st_size < (off_t)sizeof(capture_header_t)) )
+	{
+		fprintf(stderr, "%s: not a capture\n", path);
+		close(fd);
+		return -1;
+	}
+
+	const uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED)
+	{
+		perror(path);
+		return -1;
+	}
+
+	const capture_header_t *header = (const capture_header_t *)data;
+	if(!capture_header_check(header))
+	{
+		fprintf(stderr, "%s: not a capture or unsupported version\n", path);
+		munmap((void *)data, st.st_size);
+		return -1;
+	}
+
+	const uint8_t *ptr = data + sizeof(capture_header_t);
+	const uint8_t *end = data + st.st_size;
+	const capture_record_t *rec;
+	uint64_t frame = 0;
+	uint64_t n_event = 0;
+	uint64_t n_dump = 0;
+	uint64_t n_other = 0;
+	uint32_t active = 0;
+	uint32_t max_active = 0;
+	int32_t values [SENSOR_MAX];
+
+	while( (rec = capture_record_next(&ptr, end)) )
+	{
+		frame += rec->delta;
+
+		switch(rec->type)
+		{
+			case CAPTURE_TYPE_EVENT:
+			{
+				chimaera_event_t cev;
+				if(!capture_event_read(rec, &cev))
+					break; // skip malformed records
+				n_event++;
+
+				// simultaneous blobs, assuming a well-formed stream
+				if(cev.state == CHIMAERA_STATE_ON)
+					active++;
+				else if( (cev.state == CHIMAERA_STATE_OFF) && active)
+					active--;
+				else if(cev.state == CHIMAERA_STATE_IDLE)
+					active = 0;
+				if(active > max_active)
+					max_active = active;
+
+				if(!summary)
+					printf("%"PRIu64" %s %"PRIu32" %"PRIu32" %"PRIu32" %f %f %f %f\n",
+						frame, _state_name(cev.state), cev.sid, cev.gid, cev.pid,
+						cev.x, cev.z, cev.X, cev.Z);
+				break;
+			}
+			case CAPTURE_TYPE_DUMP:
+			{
+				const uint32_t sensors = capture_dump_read(rec, values, SENSOR_MAX);
+				n_dump++;
+
+				if(!summary)
+				{
+					printf("%"PRIu64" dump %"PRIu32, frame, sensors);
+					for(uint32_t i=0; i<sensors; i++)
+						printf(" %"PRIi32, values[i]);
+					printf("\n");
+				}
+				break;
+			}
+			default:
+			{
+				n_other++;
+				break;
+			}
+		}
+	}
+
+	if(ptr != end)
+		fprintf(stderr, "%s: truncated after %"PRIu64" frames\n", path, frame);
+
+	if(summary)
+	{
+		printf("rate:     %"PRIu32" Hz\n", header->rate);
+		printf("duration: %.3f s\n", header->rate ? (double)frame / header->rate : 0.0);
+		printf("events:   %"PRIu64"\n", n_event);
+		printf("dumps:    %"PRIu64"\n", n_dump);
+		printf("unknown:  %"PRIu64"\n", n_other);
+		printf("blobs:    %"PRIu32" max\n", max_active);
+	}
+
+	munmap((void *)data, st.st_size);
+
+	return 0;
+}
@@ -0,0 +1,859 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// renders captures written by the recorder plugin through a chain of plugins
+// faster than realtime, one capture per job, jobs spread over all cores
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <capture.h>
+
+#include <lv2/lv2plug.in/ns/ext/midi/midi.h>
+
+#define URID_MAX 512
+#define STAGE_MAX 8
+#define PORT_MAX 16
+#define SENSOR_MAX 160
+#define BUF_SIZE 0x10000 // per port
+#define TICKS_PER_BEAT 960 // at 120 bpm
+
+typedef enum _output_t output_t;
+typedef struct _plugin_t plugin_t;
+typedef struct _stage_t stage_t;
+typedef struct _job_t job_t;
+typedef struct _queue_t queue_t;
+typedef struct _blob_t blob_t;
+typedef struct _render_t render_t;
+typedef struct _worker_t worker_t;
+
+enum _output_t {
+	OUTPUT_EVENT	= 0, // chimaera events and dumps, written as capture
+	OUTPUT_MIDI		= 1 // written as standard MIDI file
+};
+
+// port kinds: e: event input, o: atom output, c: control input
+struct _plugin_t {
+	const char *name;
+	const char *uri;
+	output_t output;
+	const char *ports;
+	float defaults [PORT_MAX];
+};
+
+struct _stage_t {
+	const plugin_t *plugin;
+	float controls [PORT_MAX];
+};
+
+struct _job_t {
+	const char *path;
+	char *out;
+	uint64_t frames;
+	uint64_t records;
+	uint32_t rate;
+	double seconds;
+	int failed;
+};
+
+// jobs [head, tail) of a worker, claimed from the front by owner and thieves
+struct _queue_t {
+	atomic_uint head;
+	unsigned tail;
+} __attribute__((aligned(64)));
+
+struct _blob_t {
+	uint8_t *buf;
+	size_t size;
+	size_t max;
+};
+
+struct _render_t {
+	pthread_mutex_t lock;
+	char *urids [URID_MAX];
+	unsigned n_urids;
+	LV2_URID_Map map;
+	LV2_URID midi_MidiEvent;
+
+	stage_t stages [STAGE_MAX];
+	unsigned n_stages;
+	uint32_t block;
+	const char *outdir;
+
+	job_t *jobs;
+	unsigned n_jobs;
+
+	worker_t *workers;
+	unsigned n_workers;
+};
+
+struct _worker_t {
+	render_t *render;
+	unsigned id;
+	pthread_t thread;
+	queue_t queue;
+	chimaera_forge_t cforge;
+	unsigned stolen;
+};
+
+static const plugin_t plugins [] = {
+	{
+		.name = "filter", .uri = CHIMAERA_FILTER_URI, .output = OUTPUT_EVENT,
+		.ports = "eoccccccc",
+		.defaults = {[2] = 255, [3] = 1, [4] = 1, [5] = 1, [6] = 1, [7] = 1, [8] = 1}
+	},
+	{
+		.name = "mapper", .uri = CHIMAERA_MAPPER_URI, .output = OUTPUT_EVENT,
+		.ports = "eocc",
+		.defaults = {[2] = 128, [3] = 1}
+	},
+	{
+		.name = "mogrifier", .uri = CHIMAERA_MOGRIFIER_URI, .output = OUTPUT_EVENT,
+		.ports = "eocccc",
+		.defaults = {[2] = 1, [4] = 1}
+	},
+	{
+		.name = "midi_out", .uri = CHIMAERA_MIDI_OUT_URI, .output = OUTPUT_MIDI,
+		.ports = "eoccccccc",
+		.defaults = {[2] = 128, [4] = 2, [5] = 7}
+	},
+	{
+		.name = "mpe_out", .uri = CHIMAERA_MPE_OUT_URI, .output = OUTPUT_MIDI,
+		.ports = "eocccccc",
+		.defaults = {[2] = 128, [3] = 2, [4] = 2}
+	},
+	{
+		.name = NULL
+	}
+};
+
+static LV2_URID
+_map(LV2_URID_Map_Handle instance, const char *uri)
+{
+	render_t *render = instance;
+	LV2_URID urid = 0;
+
+	pthread_mutex_lock(&render->lock);
+
+	for(unsigned i=0; i<render->n_urids; i++)
+	{
+		if(!strcmp(render->urids[i], uri))
+		{
+			urid = i + 1;
+			break;
+		}
+	}
+
+	if(!urid && (render->n_urids < URID_MAX) )
+	{
+		render->urids[render->n_urids] = strdup(uri);
+		urid = ++render->n_urids;
+	}
+
+	pthread_mutex_unlock(&render->lock);
+
+	return urid;
+}
+
+static const LV2_Descriptor *
+_descriptor(const char *uri)
+{
+	const LV2_Descriptor *desc;
+
+	for(uint32_t i=0; (desc = lv2_descriptor(i)); i++)
+	{
+		if(!strcmp(desc->URI, uri))
+			return desc;
+	}
+
+	return NULL;
+}
+
+// parses NAME[:PORT=VALUE[:PORT=VALUE...]][,NAME...]
+static int
+_chain_parse(render_t *render, char *spec)
+{
+	char *save_stage;
+
+	for(char *tok = strtok_r(spec, ",", &save_stage);
+		tok;
+		tok = strtok_r(NULL, ",", &save_stage))
+	{
+		if(render->n_stages >= STAGE_MAX)
+		{
+			fprintf(stderr, "chain: too many stages\n");
+			return -1;
+		}
+
+		stage_t *stage = &render->stages[render->n_stages++];
+		char *save_arg;
+		char *name = strtok_r(tok, ":", &save_arg);
+
+		stage->plugin = NULL;
+		for(const plugin_t *plugin = plugins; plugin->name; plugin++)
+		{
+			if(name && !strcmp(plugin->name, name))
+			{
+				stage->plugin = plugin;
+				break;
+			}
+		}
+
+		if(!stage->plugin)
+		{
+			fprintf(stderr, "chain: unknown plugin '%s'\n", name ? name : "");
+			return -1;
+		}
+
+		memcpy(stage->controls, stage->plugin->defaults, sizeof(stage->controls));
+
+		for(char *arg = strtok_r(NULL, ":", &save_arg);
+			arg;
+			arg = strtok_r(NULL, ":", &save_arg))
+		{
+			unsigned port;
+			float value;
+
+			if( (sscanf(arg, "%u=%f", &port, &value) != 2)
+				|| (port >= strlen(stage->plugin->ports))
+				|| (stage->plugin->ports[port] != 'c') )
+			{
+				fprintf(stderr, "chain: invalid control '%s' for %s\n", arg, name);
+				return -1;
+			}
+
+			stage->controls[port] = value;
+		}
+	}
+
+	for(unsigned i=0; i+1<render->n_stages; i++)
+	{
+		if(render->stages[i].plugin->output != OUTPUT_EVENT)
+		{
+			fprintf(stderr, "chain: %s must be last\n", render->stages[i].plugin->name);
+			return -1;
+		}
+	}
+
+	return render->n_stages ? 0 : -1;
+}
+
+static int
+_blob_append(blob_t *blob, const void *src, size_t size)
+{
+	if(blob->size + size > blob->max)
+	{
+		const size_t max = (blob->max ? blob->max * 2 : 0x10000) + size;
+		uint8_t *buf = realloc(blob->buf, max);
+		if(!buf)
+			return -1;
+
+		blob->buf = buf;
+		blob->max = max;
+	}
+
+	memcpy(blob->buf + blob->size, src, size);
+	blob->size += size;
+
+	return 0;
+}
+
+static int
+_blob_varlen(blob_t *blob, uint32_t value)
+{
+	uint8_t tmp [5];
+	unsigned n = 0;
+
+	tmp[n++] = value & 0x7f;
+	while( (value >>= 7) )
+		tmp[n++] = 0x80 | (value & 0x7f);
+
+	// most significant group first
+	for(unsigned i=0; i<n/2; i++)
+	{
+		const uint8_t t = tmp[i];
+		tmp[i] = tmp[n-1-i];
+		tmp[n-1-i] = t;
+	}
+
+	return _blob_append(blob, tmp, n);
+}
+
+static int
+_blob_write(const blob_t *blob, const char *path, const void *head, size_t head_size)
+{
+	FILE *f = fopen(path, "wb");
+	if(!f)
+	{
+		perror(path);
+		return -1;
+	}
+
+	int failed = (head_size && (fwrite(head, head_size, 1, f) != 1) )
+		|| (blob->size && (fwrite(blob->buf, blob->size, 1, f) != 1) );
+
+	if(fclose(f) || failed)
+	{
+		perror(path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+_midi_write(const blob_t *track, const char *path)
+{
+	const uint32_t len = track->size;
+	const uint8_t head [22] = {
+		'M', 'T', 'h', 'd',
+		0, 0, 0, 6,
+		0, 0, // format 0
+		0, 1, // one track
+		TICKS_PER_BEAT >> 8, TICKS_PER_BEAT & 0xff,
+		'M', 'T', 'r', 'k',
+		len >> 24, (len >> 16) & 0xff, (len >> 8) & 0xff, len & 0xff
+	};
+
+	return _blob_write(track, path, head, sizeof(head));
+}
+
+// collects the output of the last stage, returns the number of records
+static uint64_t
+_collect(worker_t *worker, output_t output, const LV2_Atom_Sequence *seq,
+	uint64_t offset, uint32_t rate, uint64_t *last, blob_t *blob)
+{
+	render_t *render = worker->render;
+	uint64_t n = 0;
+
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const uint64_t abs = offset + ev->time.frames;
+		const LV2_Atom *atom = &ev->body;
+
+		if(output == OUTPUT_MIDI)
+		{
+			if( (atom->type != render->midi_MidiEvent) || !atom->size)
+				continue;
+
+			const uint64_t ticks = abs * 2 * TICKS_PER_BEAT / rate;
+			const uint8_t *m = LV2_ATOM_BODY_CONST(atom);
+
+			_blob_varlen(blob, ticks - *last);
+			if(m[0] == 0xf0) // sysex is prefixed with its length
+			{
+				_blob_append(blob, m, 1);
+				_blob_varlen(blob, atom->size - 1);
+				_blob_append(blob, m + 1, atom->size - 1);
+			}
+			else
+			{
+				_blob_append(blob, m, atom->size);
+			}
+			*last = ticks;
+			n++;
+		}
+		else
+		{
+			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)atom;
+			uint8_t rec [sizeof(capture_record_t) + SENSOR_MAX*sizeof(int16_t)];
+			uint32_t size = 0;
+
+			if(chimaera_event_check_type(&worker->cforge, &obj->atom))
+			{
+				chimaera_event_t cev;
+				chimaera_event_deforge(&worker->cforge, &obj->atom, &cev);
+				size = capture_event_write(rec, abs - *last, &cev);
+			}
+			else if(chimaera_dump_check_type(&worker->cforge, &obj->atom))
+			{
+				const chimaera_dump_t *dump = (const chimaera_dump_t *)obj;
+				uint32_t sensors = (dump->cobj.prop.value.size - sizeof(LV2_Atom_Vector_Body))
+					/ sizeof(int32_t);
+				if(sensors > SENSOR_MAX)
+					sensors = SENSOR_MAX;
+				const int32_t *values = chimaera_dump_deforge(&worker->cforge, &obj->atom, NULL);
+				size = capture_dump_write(rec, abs - *last, values, sensors);
+			}
+
+			if(size)
+			{
+				_blob_append(blob, rec, size);
+				*last = abs;
+				n++;
+			}
+		}
+	}
+
+	return n;
+}
+
+static int
+_render(worker_t *worker, job_t *job)
+{
+	render_t *render = worker->render;
+	LV2_Atom_Forge *forge = &worker->cforge.forge;
+	const plugin_t *last_plugin = render->stages[render->n_stages - 1].plugin;
+	int failed = -1;
+
+	const int fd = open(job->path, O_RDONLY);
+	if(fd < 0)
+	{
+		perror(job->path);
+		return -1;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) || (st.st_size < (off_t)sizeof(capture_header_t)) )
+	{
+		fprintf(stderr, "%s: not a capture\n", job->path);
+		close(fd);
+		return -1;
+	}
+
+	const uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED)
+	{
+		perror(job->path);
+		return -1;
+	}
+
+	const capture_header_t *header = (const capture_header_t *)data;
+	if(!capture_header_check(header) || !header->rate)
+	{
+		fprintf(stderr, "%s: not a capture or unsupported version\n", job->path);
+		munmap((void *)data, st.st_size);
+		return -1;
+	}
+	job->rate = header->rate;
+
+	const LV2_Feature map_feature = {
+		.URI = LV2_URID__map,
+		.data = &render->map
+	};
+	const LV2_Feature *const features [] = {
+		&map_feature,
+		NULL
+	};
+
+	const LV2_Descriptor *descs [STAGE_MAX] = {NULL};
+	LV2_Handle instances [STAGE_MAX] = {NULL};
+	uint8_t *bufs [STAGE_MAX + 1] = {NULL}; // input of first stage plus outputs
+	blob_t blob = {NULL, 0, 0};
+
+	for(unsigned s=0; s<=render->n_stages; s++)
+	{
+		if(!(bufs[s] = aligned_alloc(64, BUF_SIZE)))
+			goto fail;
+		memset(bufs[s], 0x0, BUF_SIZE);
+	}
+
+	for(unsigned s=0; s<render->n_stages; s++)
+	{
+		const stage_t *stage = &render->stages[s];
+		const unsigned n_ports = strlen(stage->plugin->ports);
+
+		descs[s] = _descriptor(stage->plugin->uri);
+		if(!descs[s])
+			goto fail;
+
+		instances[s] = descs[s]->instantiate(descs[s], header->rate, "", features);
+		if(!instances[s])
+			goto fail;
+
+		descs[s]->connect_port(instances[s], 0, bufs[s]);
+		descs[s]->connect_port(instances[s], 1, bufs[s + 1]);
+		for(unsigned p=2; p<n_ports; p++)
+			descs[s]->connect_port(instances[s], p, (void *)&stage->controls[p]);
+
+		if(descs[s]->activate)
+			descs[s]->activate(instances[s]);
+	}
+
+	const uint8_t *ptr = data + sizeof(capture_header_t);
+	const uint8_t *end = data + st.st_size;
+	const capture_record_t *rec = capture_record_next(&ptr, end);
+	uint64_t abs = rec ? rec->delta : 0;
+	uint64_t last = 0;
+	unsigned tail = 1; // run one more block past the last record
+
+	for(uint64_t offset=0; rec || tail; offset+=render->block)
+	{
+		LV2_Atom_Forge_Frame frame;
+		LV2_Atom_Forge_Ref ref;
+
+		if(!rec)
+			tail--;
+
+		lv2_atom_forge_set_buffer(forge, bufs[0], BUF_SIZE);
+		ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+		for( ; rec && (abs < offset + render->block); )
+		{
+			// only records that are forged get a frame time, others are skipped
+			chimaera_event_t cev;
+			if( (rec->type == CAPTURE_TYPE_EVENT) && capture_event_read(rec, &cev) )
+			{
+				if(ref)
+					ref = lv2_atom_forge_frame_time(forge, abs - offset);
+				if(ref)
+					ref = chimaera_event_forge(&worker->cforge, &cev);
+			}
+			else if(rec->type == CAPTURE_TYPE_DUMP)
+			{
+				int32_t values [SENSOR_MAX];
+				const uint32_t sensors = capture_dump_read(rec, values, SENSOR_MAX);
+				if(ref)
+					ref = lv2_atom_forge_frame_time(forge, abs - offset);
+				if(ref)
+					ref = chimaera_dump_forge(&worker->cforge, values, sensors);
+			}
+
+			job->records++;
+			if( (rec = capture_record_next(&ptr, end)) )
+				abs += rec->delta;
+		}
+
+		if(ref)
+			lv2_atom_forge_pop(forge, &frame);
+		else
+			fprintf(stderr, "%s: input overflow at frame %"PRIu64"\n", job->path, offset);
+
+		for(unsigned s=0; s<render->n_stages; s++)
+		{
+			LV2_Atom_Sequence *seq = (LV2_Atom_Sequence *)bufs[s + 1];
+			seq->atom.type = 0;
+			seq->atom.size = BUF_SIZE - sizeof(LV2_Atom);
+
+			descs[s]->run(instances[s], render->block);
+		}
+
+		_collect(worker, last_plugin->output,
+			(const LV2_Atom_Sequence *)bufs[render->n_stages], offset, header->rate,
+			&last, &blob);
+
+		job->frames = offset + render->block;
+	}
+
+	if(ptr != end)
+		fprintf(stderr, "%s: truncated after %"PRIu64" frames\n", job->path, abs);
+
+	if(last_plugin->output == OUTPUT_MIDI)
+	{
+		const uint8_t eot [4] = {0x00, 0xff, 0x2f, 0x00};
+		_blob_append(&blob, eot, sizeof(eot));
+		failed = _midi_write(&blob, job->out);
+	}
+	else
+	{
+		capture_header_t head;
+		capture_header_init(&head, header->rate);
+		failed = _blob_write(&blob, job->out, &head, sizeof(head));
+	}
+
+fail:
+	for(unsigned s=0; s<render->n_stages; s++)
+	{
+		if(!instances[s])
+			continue;
+
+		if(descs[s]->deactivate)
+			descs[s]->deactivate(instances[s]);
+		descs[s]->cleanup(instances[s]);
+	}
+	for(unsigned s=0; s<=render->n_stages; s++)
+		free(bufs[s]);
+	free(blob.buf);
+	munmap((void *)data, st.st_size);
+
+	if(failed)
+		fprintf(stderr, "%s: rendering failed\n", job->path);
+
+	return failed;
+}
+
+// outdir/basename(path) with its extension replaced by the output's one
+static char *
+_output_name(const render_t *render, const char *path)
+{
+	const plugin_t *last_plugin = render->stages[render->n_stages - 1].plugin;
+	char *base = strdup(path);
+	char *out = NULL;
+
+	if(!base)
+		return NULL;
+
+	char *name = basename(base);
+	char *dot = strrchr(name, '.');
+	if(dot && (dot != name) )
+		*dot = '\0';
+
+	if(asprintf(&out, "%s/%s.%s", render->outdir, name,
+		last_plugin->output == OUTPUT_MIDI ? "mid" : "cap") == -1)
+	{
+		out = NULL;
+	}
+	free(base);
+
+	return out;
+}
+
+// every job needs an output of its own, which must not be any of the inputs
+static int
+_outputs_check(render_t *render)
+{
+	for(unsigned i=0; i<render->n_jobs; i++)
+	{
+		job_t *job = &render->jobs[i];
+
+		if(!(job->out = _output_name(render, job->path)))
+			return -1;
+
+		for(unsigned j=0; j<i; j++)
+		{
+			if(!strcmp(render->jobs[j].out, job->out))
+			{
+				fprintf(stderr, "%s: output %s already written for %s\n", job->path,
+					job->out, render->jobs[j].path);
+				return -1;
+			}
+		}
+	}
+
+	for(unsigned i=0; i<render->n_jobs; i++)
+	{
+		const job_t *job = &render->jobs[i];
+		struct stat out_st;
+
+		if(stat(job->out, &out_st))
+			continue; // not yet there
+
+		for(unsigned j=0; j<render->n_jobs; j++)
+		{
+			struct stat in_st;
+
+			if(!stat(render->jobs[j].path, &in_st)
+				&& (in_st.st_dev == out_st.st_dev) && (in_st.st_ino == out_st.st_ino) )
+			{
+				fprintf(stderr, "%s: output %s would overwrite input %s\n", job->path,
+					job->out, render->jobs[j].path);
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static inline int
+_claim(queue_t *queue, unsigned *idx)
+{
+	if(atomic_load_explicit(&queue->head, memory_order_relaxed) >= queue->tail)
+		return 0;
+
+	*idx = atomic_fetch_add_explicit(&queue->head, 1, memory_order_relaxed);
+
+	return *idx < queue->tail;
+}
+
+static void *
+_worker(void *data)
+{
+	worker_t *worker = data;
+	render_t *render = worker->render;
+	unsigned idx;
+
+	chimaera_forge_init(&worker->cforge, &render->map);
+
+	while(1)
+	{
+		if(!_claim(&worker->queue, &idx))
+		{
+			// own queue drained, steal from the others
+			int found = 0;
+			for(unsigned i=1; i<render->n_workers; i++)
+			{
+				worker_t *victim = &render->workers[(worker->id + i) % render->n_workers];
+				if( (found = _claim(&victim->queue, &idx)) )
+				{
+					worker->stolen++;
+					break;
+				}
+			}
+
+			if(!found)
+				break;
+		}
+
+		job_t *job = &render->jobs[idx];
+		struct timespec t0, t1;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		job->failed = _render(worker, job);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		job->seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+	}
+
+	return NULL;
+}
+
+static void
+_usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s -c CHAIN [-j THREADS] [-b BLOCK] [-o DIR] FILE...\n"
+		"  -c  plugin chain NAME[:PORT=VALUE...][,NAME...]\n"
+		"      e.g. mapper:3=1,mpe_out:6=1\n"
+		"  -j  number of worker threads (default all cores)\n"
+		"  -b  block size (default 256)\n"
+		"  -o  output directory (default .)\n"
+		"chains ending in midi_out or mpe_out write standard MIDI files,\n"
+		"all others write captures\n"
+		"plugins:", name);
+	for(const plugin_t *plugin = plugins; plugin->name; plugin++)
+		fprintf(stderr, " %s", plugin->name);
+	fprintf(stderr, "\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	static render_t render;
+	char *chain = NULL;
+	long n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	int c;
+
+	render.block = 256;
+	render.outdir = ".";
+
+	while( (c = getopt(argc, argv, "c:j:b:o:h")) != -1)
+	{
+		switch(c)
+		{
+			case 'c':
+				chain = optarg;
+				break;
+			case 'j':
+				n_workers = atoi(optarg);
+				break;
+			case 'b':
+				render.block = atoi(optarg);
+				break;
+			case 'o':
+				render.outdir = optarg;
+				break;
+			default:
+				_usage(argv[0]);
+				return -1;
+		}
+	}
+
+	if(!chain || (optind >= argc) || !render.block)
+	{
+		_usage(argv[0]);
+		return -1;
+	}
+
+	pthread_mutex_init(&render.lock, NULL);
+	render.map.handle = &render;
+	render.map.map = _map;
+	render.midi_MidiEvent = _map(&render, LV2_MIDI__MidiEvent);
+
+	if(_chain_parse(&render, chain))
+	{
+		_usage(argv[0]);
+		return -1;
+	}
+
+	render.n_jobs = argc - optind;
+	render.jobs = calloc(render.n_jobs, sizeof(job_t));
+	for(unsigned i=0; i<render.n_jobs; i++)
+		render.jobs[i].path = argv[optind + i];
+
+	if(_outputs_check(&render))
+		return -1;
+
+	if(n_workers < 1)
+		n_workers = 1;
+	if(n_workers > render.n_jobs)
+		n_workers = render.n_jobs;
+	render.n_workers = n_workers;
+	render.workers = calloc(render.n_workers, sizeof(worker_t));
+
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	// contiguous slices per worker, stealing evens out uneven capture lengths
+	for(unsigned i=0; i<render.n_workers; i++)
+	{
+		worker_t *worker = &render.workers[i];
+
+		worker->render = &render;
+		worker->id = i;
+		atomic_init(&worker->queue.head, render.n_jobs * i / render.n_workers);
+		worker->queue.tail = render.n_jobs * (i + 1) / render.n_workers;
+	}
+	for(unsigned i=0; i<render.n_workers; i++)
+		pthread_create(&render.workers[i].thread, NULL, _worker, &render.workers[i]);
+	for(unsigned i=0; i<render.n_workers; i++)
+		pthread_join(render.workers[i].thread, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	const double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+	double signal = 0.0;
+	unsigned failed = 0;
+	unsigned stolen = 0;
+	for(unsigned i=0; i<render.n_jobs; i++)
+	{
+		const job_t *job = &render.jobs[i];
+		FILE *f = job->failed ? stderr : stdout;
+
+		fprintf(f, "%s: %s, %"PRIu64" records, %.3f s\n", job->path,
+			job->failed ? "failed" : "ok", job->records, job->seconds);
+		failed += job->failed ? 1 : 0;
+		if(!job->failed)
+			signal += (double)job->frames / job->rate;
+	}
+	for(unsigned i=0; i<render.n_workers; i++)
+		stolen += render.workers[i].stolen;
+
+	printf("%u captures, %u failed, %u threads, %u stolen, %.3f s, %.1fx realtime\n",
+		render.n_jobs, failed, render.n_workers, stolen, wall,
+		wall > 0.0 ? signal / wall : 0.0);
+
+	for(unsigned i=0; i<render.n_urids; i++)
+		free(render.urids[i]);
+	free(render.workers);
+	for(unsigned i=0; i<render.n_jobs; i++)
+		free(render.jobs[i].out);
+	free(render.jobs);
+	pthread_mutex_destroy(&render.lock);
+
+	return failed ? -1 : 0;
+}
@@ -17,15 +17,48 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include <chimaera.h>
 
+typedef enum _cv_chan_t cv_chan_t;
+typedef enum _interpolation_t interpolation_t;
+typedef struct _cv_t cv_t;
 typedef struct _handle_t handle_t;
 
+enum _cv_chan_t {
+	CV_GATE = 0,
+	CV_X,
+	CV_Z,
+	CV_VX,
+	CV_VZ,
+
+	CV_MAX
+};
+
+enum _interpolation_t {
+	INTERPOLATION_STEP = 0,
+	INTERPOLATION_LINEAR = 1,
+	INTERPOLATION_ONE_POLE = 2
+};
+
+struct _cv_t {
+	float *out;
+	float val; // currently rendered value
+	float tar; // value set by latest event
+};
+
 struct _handle_t {
 	LV2_URID_Map *map;
 	chimaera_forge_t cforge;
 
+	float rate;
+	float smoothing;
+	float a; // one-pole coefficient
+	interpolation_t interpolation;
+	uint32_t pos; // frame offset rendered up to
+	cv_t cv [CV_MAX];
+
 	const LV2_Atom_Sequence *event_in;
 	LV2_Atom_Sequence *event_out;
 	float *gate;
@@ -36,6 +69,13 @@ struct _handle_t {
 	float *z;
 	float *X;
 	float *Z;
+	const float *interpolation_in;
+	const float *smoothing_in;
+	float *latency_quant;
+	float *latency_chain;
+	float *latency_max;
+
+	chimaera_latency_stats_t latency_stats;
 };
 
 static LV2_Handle
@@ -59,6 +99,7 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 	}
 
 	chimaera_forge_init(&handle->cforge, handle->map);
+	handle->rate = rate;
 
 	return handle;
 }
@@ -100,6 +141,36 @@ connect_port(LV2_Handle instance, uint32_t port, void *data)
 		case 9:
 			handle->Z = (float *)data;
 			break;
+		case 10:
+			handle->interpolation_in = (const float *)data;
+			break;
+		case 11:
+			handle->smoothing_in = (const float *)data;
+			break;
+		case 12:
+			handle->cv[CV_GATE].out = (float *)data;
+			break;
+		case 13:
+			handle->cv[CV_X].out = (float *)data;
+			break;
+		case 14:
+			handle->cv[CV_Z].out = (float *)data;
+			break;
+		case 15:
+			handle->cv[CV_VX].out = (float *)data;
+			break;
+		case 16:
+			handle->cv[CV_VZ].out = (float *)data;
+			break;
+		case 17:
+			handle->latency_quant = (float *)data;
+			break;
+		case 18:
+			handle->latency_chain = (float *)data;
+			break;
+		case 19:
+			handle->latency_max = (float *)data;
+			break;
 		default:
 			break;
 	}
@@ -108,8 +179,83 @@ connect_port(LV2_Handle instance, uint32_t port, void *data)
 static void
 activate(LV2_Handle instance)
 {
-	//handle_t *handle = (handle_t *)instance;
-	//nothing
+	handle_t *handle = (handle_t *)instance;
+
+	for(unsigned c=0; c<CV_MAX; c++)
+	{
+		handle->cv[c].val = 0.f;
+		handle->cv[c].tar = 0.f;
+	}
+	handle->smoothing = -1.f; // force coefficient update
+}
+
+// render CV outputs from handle->pos up to frame 'end', ramping linearly
+// towards 'ramp' if given or holding/filtering the current values otherwise
+static inline void
+_cv_render(handle_t *handle, uint32_t end, const float *ramp)
+{
+	const uint32_t pos = handle->pos;
+	const uint32_t n = end - pos;
+
+	if(end <= pos)
+		return;
+
+	for(unsigned c=0; c<CV_MAX; c++)
+	{
+		cv_t *cv = &handle->cv[c];
+		float *out = cv->out;
+
+		if(!out)
+			continue;
+
+		out += pos;
+
+		if( (c == CV_GATE) || (handle->interpolation == INTERPOLATION_STEP)
+			|| ( (handle->interpolation == INTERPOLATION_LINEAR) && !ramp) )
+		{
+			const float val = cv->val;
+
+			for(unsigned i=0; i<n; i++)
+				out[i] = val;
+		}
+		else if(handle->interpolation == INTERPOLATION_LINEAR) // && ramp
+		{
+			const float val = cv->val;
+			const float inc = (ramp[c] - val) / n;
+
+			for(unsigned i=0; i<n; i++)
+				out[i] = val + inc*(i + 1);
+		}
+		else // INTERPOLATION_ONE_POLE
+		{
+			const float a = handle->a;
+			const float tar = cv->tar;
+			float val = cv->val;
+
+			for(unsigned i=0; i<n; i++)
+				out[i] = val += a*(tar - val);
+
+			cv->val = val;
+		}
+	}
+
+	handle->pos = end;
+}
+
+// render up to the event's frame, then switch to its values
+static inline void
+_cv_event(handle_t *handle, int64_t frames, const float *tar, int jump)
+{
+	_cv_render(handle, frames, jump ? NULL : tar);
+
+	for(unsigned c=0; c<CV_MAX; c++)
+	{
+		cv_t *cv = &handle->cv[c];
+
+		cv->tar = tar[c];
+		if(jump || (c == CV_GATE) || (handle->interpolation != INTERPOLATION_ONE_POLE) )
+			cv->val = tar[c];
+	}
 }
 
 static void
@@ -117,10 +263,30 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	handle_t *handle = (handle_t *)instance;
 
+	CHIMAERA_PROBE_RUN_ENTRY(CHIMAERA_CONTROL_OUT_URI, nsamples, handle->event_in);
+
 	// clone event_in to event_out
 	memcpy(handle->event_out, handle->event_in,
 		sizeof(LV2_Atom) + handle->event_in->atom.size);
 
+	handle->interpolation = handle->interpolation_in
+		? floor(*handle->interpolation_in)
+		: INTERPOLATION_STEP;
+
+	const float smoothing = handle->smoothing_in
+		? *handle->smoothing_in
+		: 1.f;
+	if(smoothing != handle->smoothing)
+	{
+		// time constant in ms
+		handle->smoothing = smoothing;
+		handle->a = smoothing > 0.f
+			? 1.f - expf(-1000.f / (smoothing * handle->rate))
+			: 1.f;
+	}
+
+	handle->pos = 0;
+
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
 	{
 		if(chimaera_event_check_type(&handle->cforge, &ev->body))
@@ -129,6 +295,25 @@ run(LV2_Handle instance, uint32_t nsamples)
 
 			chimaera_event_deforge(&handle->cforge, &ev->body, &cev);
 
+			int64_t frames = ev->time.frames;
+			if(frames < handle->pos)
+				frames = handle->pos;
+			else if(frames > nsamples)
+				frames = nsamples;
+
+			const int on = (cev.state == CHIMAERA_STATE_ON)
+				|| (cev.state == CHIMAERA_STATE_SET);
+			const float tar [CV_MAX] = {
+				[CV_GATE] = on ? 1.f : 0.f,
+				[CV_X] = on ? cev.x : 0.f,
+				[CV_Z] = on ? cev.z : 0.f,
+				[CV_VX] = on ? cev.X : 0.f,
+				[CV_VZ] = on ? cev.Z : 0.f
+			};
+
+			// only SET ramps, ON, OFF and IDLE jump
+			_cv_event(handle, frames, tar, cev.state != CHIMAERA_STATE_SET);
+
 			switch(cev.state)
 			{
 				case CHIMAERA_STATE_ON:
@@ -158,7 +343,23 @@ run(LV2_Handle instance, uint32_t nsamples)
 					break;
 			}
 		}
+		else if(chimaera_latency_check_type(&handle->cforge, &ev->body))
+		{
+			chimaera_latency_t lat;
+
+			chimaera_latency_deforge(&handle->cforge, &ev->body, &lat);
+			chimaera_latency_stats_add(&handle->latency_stats, &lat,
+				chimaera_latency_now());
+		}
 	}
+
+	// hold or filter up to the end of the period
+	_cv_render(handle, nsamples, NULL);
+
+	chimaera_latency_stats_report(&handle->latency_stats, handle->latency_quant,
+		handle->latency_chain, handle->latency_max);
+
+	CHIMAERA_PROBE_RUN_EXIT(CHIMAERA_CONTROL_OUT_URI, NULL);
 }
 
 static void
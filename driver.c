@@ -96,8 +96,14 @@ struct _handle_t {
 
 	const LV2_Atom_Sequence *osc_in;
 	LV2_Atom_Sequence *event_out;
+	const float *latency;
 
 	LV2_Atom_Forge_Ref ref;
+	uint64_t timetag;
+
+	chimaera_pool_t pool;
+	int32_t *values; // dump buffer, sized to the largest dump seen so far
+	uint32_t n_values;
 };
 
 // rt
@@ -289,6 +295,8 @@ _tuio2_frm(const char *path, const char *fmt, const LV2_Atom_Tuple *args,
 		}
 	}
 
+	CHIMAERA_PROBE3(tuio2_frm, fid, handle->tuio2.missed, handle->tuio2.ignore);
+
 	return 1;
 }
 
@@ -441,6 +449,8 @@ _tuio2_alv(const char *path, const char *fmt, const LV2_Atom_Tuple *args,
 			handle->ref = _chim_event(handle, handle->rel, &cev);
 	}
 
+	CHIMAERA_PROBE2(tuio2_alv, handle->tuio2.fid, n);
+
 	handle->tuio2.n = n;
 
 	return 1;
@@ -639,7 +649,6 @@ _dump(const char *path, const char *fmt, const LV2_Atom_Tuple *args,
 
 	const LV2_Atom *ptr = lv2_atom_tuple_begin(args);
 	uint32_t sensors;
-	int32_t values[160];
 
 	uint32_t fid;
 	uint32_t size;
@@ -651,6 +660,13 @@ _dump(const char *path, const char *fmt, const LV2_Atom_Tuple *args,
 	if(ptr)
 	{
 		sensors = size / sizeof(int16_t);
+		if(chimaera_pool_reserve(&handle->pool, (void **)&handle->values,
+			&handle->n_values, sensors, sizeof(int32_t)))
+		{
+			sensors = handle->n_values; // pool exhausted, truncate dump
+		}
+
+		int32_t *values = handle->values;
 		for(unsigned i=0; i<sensors; i++)
 		{
 			int16_t val = be16toh(payload[i]);
@@ -694,6 +710,13 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	if(chimaera_pool_init(&handle->pool, CHIMAERA_POOL_SIZE))
+	{
+		fprintf(stderr, "%s: failed to reserve memory pool\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
 	chimaera_forge_init(&handle->cforge, handle->map);
 	osc_forge_init(&handle->oforge, handle->map);
 	CHIMAERA_DICT_INIT(handle->dummy.dict, handle->dummy.ref);
@@ -719,6 +742,9 @@ connect_port(LV2_Handle instance, uint32_t port, void *data)
 		case 1:
 			handle->event_out = (LV2_Atom_Sequence *)data;
 			break;
+		case 2:
+			handle->latency = (const float *)data;
+			break;
 		default:
 			break;
 	}
@@ -780,13 +806,27 @@ _message_cb(const char *path, const char *fmt, const LV2_Atom_Tuple *args,
 	}
 }
 
+static void
+_bundle_push_cb(uint64_t timestamp, void *data)
+{
+	handle_t *handle = data;
+
+	handle->timetag = timestamp;
+}
+
 static void
 run(LV2_Handle instance, uint32_t nsamples)
 {
 	handle_t *handle = (handle_t *)instance;
+
+	CHIMAERA_PROBE_RUN_ENTRY(CHIMAERA_DRIVER_URI, nsamples, handle->osc_in);
 	
 	handle->stamp += nsamples;
 
+	// the block is assumed to end at its run, thus frames lie in the past
+	const bool latency = handle->latency && (*handle->latency > 0.f);
+	const uint64_t now = latency ? chimaera_latency_now() : 0;
+
 	LV2_Atom_Forge *forge = &handle->cforge.forge;
 	uint32_t capacity = handle->event_out->atom.size;
 	LV2_Atom_Forge_Frame frame;
@@ -798,13 +838,36 @@ run(LV2_Handle instance, uint32_t nsamples)
 	{
 		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
 
-		osc_atom_event_unroll(&handle->oforge, obj, NULL, NULL, _message_cb, handle);
+		handle->rel = ev->time.frames;
+		handle->timetag = 1; // immediate
+
+		osc_atom_event_unroll(&handle->oforge, obj, _bundle_push_cb, NULL,
+			_message_cb, handle);
+
+		if(latency)
+		{
+			const chimaera_latency_t lat = {
+				.arrival = now - (nsamples - handle->rel) * 1e9 / handle->rate,
+				.dispatch = chimaera_latency_now(),
+				.timetag = handle->timetag
+			};
+
+			if(handle->ref)
+				handle->ref = lv2_atom_forge_frame_time(forge, handle->rel);
+			if(handle->ref)
+				handle->ref = chimaera_latency_forge(&handle->cforge, &lat);
+		}
 	}
 
 	if(handle->ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
+		CHIMAERA_PROBE1(forge_overflow, CHIMAERA_DRIVER_URI);
 		lv2_atom_sequence_clear(handle->event_out);
+	}
+
+	CHIMAERA_PROBE_RUN_EXIT(CHIMAERA_DRIVER_URI, handle->event_out);
 }
 
 static void
@@ -812,6 +875,7 @@ cleanup(LV2_Handle instance)
 {
 	handle_t *handle = (handle_t *)instance;
 
+	chimaera_pool_deinit(&handle->pool);
 	free(handle);
 }
 
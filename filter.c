@@ -128,6 +128,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	handle_t *handle = (handle_t *)instance;
 
+	CHIMAERA_PROBE_RUN_ENTRY(CHIMAERA_FILTER_URI, nsamples, handle->event_in);
+
 	uint8_t group_mask = floor(*handle->group_sel);
 	uint32_t north = *handle->north_sel > 0.f ? 0x80 : 0;
 	uint32_t south = *handle->south_sel > 0.f ? 0x100 : 0;
@@ -170,12 +172,26 @@ run(LV2_Handle instance, uint32_t nsamples)
 					ref = _chim_event(handle, frames, &cev);
 			}
 		}
+		else if(chimaera_latency_check_type(&handle->cforge, &ev->body) && ref)
+		{
+			chimaera_latency_t lat;
+
+			chimaera_latency_deforge(&handle->cforge, &ev->body, &lat);
+			ref = lv2_atom_forge_frame_time(forge, ev->time.frames);
+			if(ref)
+				ref = chimaera_latency_forge(&handle->cforge, &lat);
+		}
 	}
 
 	if(ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
+		CHIMAERA_PROBE1(forge_overflow, CHIMAERA_FILTER_URI);
 		lv2_atom_sequence_clear(handle->event_out);
+	}
+
+	CHIMAERA_PROBE_RUN_EXIT(CHIMAERA_FILTER_URI, handle->event_out);
 }
 
 static void
@@ -154,6 +154,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	handle_t *handle = (handle_t *)instance;
 
+	CHIMAERA_PROBE_RUN_ENTRY(CHIMAERA_MAPPER_URI, nsamples, handle->event_in);
+
 	int order = floor(*handle->mode);
 
 	if(handle->order != order)
@@ -184,12 +186,26 @@ run(LV2_Handle instance, uint32_t nsamples)
 			chimaera_event_deforge(&handle->cforge, &ev->body, &cev);
 			ref = _chim_event(handle, frames, &cev);
 		}
+		else if(chimaera_latency_check_type(&handle->cforge, &ev->body) && ref)
+		{
+			chimaera_latency_t lat;
+
+			chimaera_latency_deforge(&handle->cforge, &ev->body, &lat);
+			ref = lv2_atom_forge_frame_time(forge, ev->time.frames);
+			if(ref)
+				ref = chimaera_latency_forge(&handle->cforge, &lat);
+		}
 	}
 
 	if(ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
+		CHIMAERA_PROBE1(forge_overflow, CHIMAERA_MAPPER_URI);
 		lv2_atom_sequence_clear(handle->event_out);
+	}
+
+	CHIMAERA_PROBE_RUN_EXIT(CHIMAERA_MAPPER_URI, handle->event_out);
 }
 
 static void
@@ -20,7 +20,12 @@
 #include <math.h>
 
 #include <chimaera.h>
+#include <midi_sched.h>
 
+#define CHAN_MAX 16
+
+typedef struct _cache_t cache_t;
+typedef struct _chan_t chan_t;
 typedef struct _ref_t ref_t;
 typedef struct _handle_t handle_t;
 
@@ -30,9 +35,26 @@ enum {
 	Z_MAPPING_CHANNEL_PRESSURE = 2
 };
 
+// last value sent for a given message, plus a value held back by the
+// minimum interval which still needs to go out
+struct _cache_t {
+	uint16_t val;
+	uint16_t pend;
+	uint64_t stamp;
+	bool valid;
+	bool dirty;
+};
+
+struct _chan_t {
+	cache_t bend;
+	cache_t control;
+	cache_t pressure;
+};
+
 struct _ref_t {
 	uint8_t chn;
 	uint8_t key;
+	cache_t pressure;
 };
 
 struct _handle_t {
@@ -50,12 +72,30 @@ struct _handle_t {
 	int n;
 	int oct;
 
+	chan_t chan [CHAN_MAX];
+	uint8_t ctrl;
+	uint16_t deadband;
+	uint64_t interval;
+	uint64_t stamp;
+	float rate;
+
+	midi_sched_t sched;
+	bool scheduled;
+
 	const LV2_Atom_Sequence *event_in;
 	const float *sensors;
 	const float *z_mapping;
 	const float *octave;
 	const float *controller;
+	const float *deadband_in;
+	const float *interval_in;
+	const float *bandwidth;
 	LV2_Atom_Sequence *midi_out;
+	float *latency_quant;
+	float *latency_chain;
+	float *latency_max;
+
+	chimaera_latency_stats_t latency_stats;
 };
 
 static LV2_Handle
@@ -81,6 +121,8 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 	handle->uris.midi_MidiEvent = handle->map->map(handle->map->handle, LV2_MIDI__MidiEvent);
 	chimaera_forge_init(&handle->cforge, handle->map);
 	CHIMAERA_DICT_INIT(handle->dict, handle->ref);
+	midi_sched_init(&handle->sched, rate);
+	handle->rate = rate;
 
 	return handle;
 }
@@ -110,16 +152,104 @@ connect_port(LV2_Handle instance, uint32_t port, void *data)
 		case 5:
 			handle->controller = (const float *)data;
 			break;
+		case 6:
+			handle->deadband_in = (const float *)data;
+			break;
+		case 7:
+			handle->interval_in = (const float *)data;
+			break;
+		case 8:
+			handle->bandwidth = (const float *)data;
+			break;
+		case 9:
+			handle->latency_quant = (float *)data;
+			break;
+		case 10:
+			handle->latency_chain = (float *)data;
+			break;
+		case 11:
+			handle->latency_max = (float *)data;
+			break;
 		default:
 			break;
 	}
 }
 
+static inline void
+_cache_invalidate(cache_t *cache)
+{
+	cache->valid = false;
+	cache->dirty = false;
+}
+
 static void
 activate(LV2_Handle instance)
 {
-	//handle_t *handle = (handle_t *)instance;
-	//nothing
+	handle_t *handle = (handle_t *)instance;
+
+	for(unsigned i=0; i<CHAN_MAX; i++)
+	{
+		chan_t *chan = &handle->chan[i];
+
+		_cache_invalidate(&chan->bend);
+		_cache_invalidate(&chan->control);
+		_cache_invalidate(&chan->pressure);
+	}
+
+	handle->stamp = 0;
+	midi_sched_reset(&handle->sched);
+}
+
+// returns whether a new value needs to be sent right now, postpones it if
+// the minimum interval since the last send has not yet elapsed
+static inline bool
+_cache_update(handle_t *handle, cache_t *cache, uint16_t val, uint16_t deadband,
+	int64_t frames)
+{
+	const uint64_t stamp = handle->stamp + frames;
+
+	if(cache->valid)
+	{
+		const uint16_t diff = val > cache->val
+			? val - cache->val
+			: cache->val - val;
+
+		if(diff <= deadband)
+		{
+			cache->dirty = false; // a postponed value is superseded
+			return false;
+		}
+
+		if(stamp < cache->stamp + handle->interval)
+		{
+			cache->pend = val;
+			cache->dirty = true;
+			return false;
+		}
+	}
+
+	cache->val = val;
+	cache->stamp = stamp;
+	cache->valid = true;
+	cache->dirty = false;
+
+	return true;
+}
+
+// returns whether a postponed value is due
+static inline bool
+_cache_flush(handle_t *handle, cache_t *cache, int64_t frames)
+{
+	const uint64_t stamp = handle->stamp + frames;
+
+	if(!cache->dirty || (stamp < cache->stamp + handle->interval) )
+		return false;
+
+	cache->val = cache->pend;
+	cache->stamp = stamp;
+	cache->dirty = false;
+
+	return true;
 }
 
 static inline LV2_Atom_Forge_Ref
@@ -127,6 +257,13 @@ _midi_event(handle_t *handle, int64_t frames, const uint8_t *m, size_t len)
 {
 	LV2_Atom_Forge *forge = &handle->cforge.forge;
 	LV2_Atom_Forge_Ref ref;
+
+	if(handle->scheduled)
+	{
+		// the scheduler forges it later, an overflow is not fatal to the sequence
+		midi_sched_push(&handle->sched, handle->stamp + frames, m, len);
+		return 1;
+	}
 		
 	ref = lv2_atom_forge_frame_time(forge, frames);
 	if(ref)
@@ -134,7 +271,10 @@ _midi_event(handle_t *handle, int64_t frames, const uint8_t *m, size_t len)
 	if(ref)
 		ref = lv2_atom_forge_raw(forge, m, len);
 	if(ref)
+	{
 		lv2_atom_forge_pad(forge, len);
+		CHIMAERA_PROBE2(midi_emit, m[0], len);
+	}
 
 	return ref;
 }
@@ -163,6 +303,14 @@ _midi_on(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 	
 	ref->chn = chn;
 	ref->key = key;
+	_cache_invalidate(&ref->pressure);
+
+	// the new note's first values must not wait for the previous note's
+	// interval to elapse, nor be swallowed by its deadband
+	chan_t *chan = &handle->chan[chn];
+	_cache_invalidate(&chan->bend);
+	_cache_invalidate(&chan->control);
+	_cache_invalidate(&chan->pressure);
 
 	return fref;
 }
@@ -190,6 +338,81 @@ _midi_off(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 	return fref;
 }
 
+static inline LV2_Atom_Forge_Ref
+_midi_bend(handle_t *handle, int64_t frames, uint8_t chn, uint16_t bnd)
+{
+	const uint8_t bnd_msb = bnd >> 7;
+	const uint8_t bnd_lsb = bnd & 0x7f;
+
+	const uint8_t bend [3] = {
+		0xe0 | chn,
+		bnd_lsb,
+		bnd_msb
+	};
+
+	return _midi_event(handle, frames, bend, 3);
+}
+
+static inline LV2_Atom_Forge_Ref
+_midi_control(handle_t *handle, int64_t frames, uint8_t chn, uint16_t eff,
+	bool msb_changed)
+{
+	LV2_Atom_Forge_Ref fref = 1;
+
+	const uint8_t controller = handle->ctrl;
+	const uint8_t eff_msb = eff >> 7;
+	const uint8_t eff_lsb = eff & 0x7f;
+
+	if(controller <= 0x0d)
+	{
+		const uint8_t control_lsb [3] = {
+			0xb0 | chn,
+			0x20 | controller,
+			eff_lsb
+		};
+		if(fref)
+			fref = _midi_event(handle, frames, control_lsb, 3);
+	}
+
+	if(msb_changed)
+	{
+		const uint8_t control_msb [3] = {
+			0xb0 | chn,
+			controller,
+			eff_msb
+		};
+		if(fref)
+			fref = _midi_event(handle, frames, control_msb, 3);
+	}
+
+	return fref;
+}
+
+static inline LV2_Atom_Forge_Ref
+_midi_note_pressure(handle_t *handle, int64_t frames, uint8_t chn, uint8_t key,
+	uint8_t eff_msb)
+{
+	const uint8_t note_pressure [3] = {
+		0xa0 | chn,
+		key,
+		eff_msb
+	};
+
+	return _midi_event(handle, frames, note_pressure, 3);
+}
+
+static inline LV2_Atom_Forge_Ref
+_midi_channel_pressure(handle_t *handle, int64_t frames, uint8_t chn,
+	uint8_t eff_msb)
+{
+	const uint8_t channel_pressure [2] = {
+		0xd0 | chn,
+		eff_msb
+	};
+
+	return _midi_event(handle, frames, channel_pressure, 2);
+}
+
 static inline LV2_Atom_Forge_Ref
 _midi_set(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 {
@@ -197,75 +420,62 @@ _midi_set(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 	if(!ref)
 		return 1;
 
-	LV2_Atom_Forge_Ref fref;
+	LV2_Atom_Forge_Ref fref = 1;
 
-	const uint8_t controller = *handle->controller;
 	const float val = handle->bot + cev->x * handle->ran;
 	
 	const uint8_t chn = ref->chn;
 	const uint8_t key = ref->key;
+	chan_t *chan = &handle->chan[chn];
 
 	const uint16_t bnd = (val-key) * handle->ran_1 * 0x2000 + 0x1fff;
-	const uint8_t bnd_msb = bnd >> 7;
-	const uint8_t bnd_lsb = bnd & 0x7f;
 
-	const uint8_t bend [3] = {
-		0xe0 | chn,
-		bnd_lsb,
-		bnd_msb
-	};
-	fref = _midi_event(handle, frames, bend, 3);
+	if(_cache_update(handle, &chan->bend, bnd, handle->deadband, frames))
+		fref = _midi_bend(handle, frames, chn, bnd);
 
 	const int z_mapping = floor(*handle->z_mapping);
 	const uint16_t eff = cev->z * 0x3fff;
-	const uint8_t eff_msb = eff >> 7;
-	const uint8_t eff_lsb = eff & 0x7f;
 
 	switch(z_mapping)
 	{
 		case Z_MAPPING_CONTROL_CHANGE:
 		{
-			if(controller <= 0x0d)
+			const uint8_t old_msb = chan->control.val >> 7;
+			const bool was_valid = chan->control.valid;
+
+			if(_cache_update(handle, &chan->control, eff, handle->deadband, frames))
 			{
-				const uint8_t control_lsb [3] = {
-					0xb0 | chn,
-					0x20 | controller,
-					eff_lsb
-				};
+				const bool msb_changed = !was_valid || ( (eff >> 7) != old_msb);
+
 				if(fref)
-					fref = _midi_event(handle, frames, control_lsb, 3);
+					fref = _midi_control(handle, frames, chn, eff, msb_changed);
 			}
 
-			const uint8_t control_msb [3] = {
-				0xb0 | chn,
-				controller,
-				eff_msb
-			};
-			if(fref)
-				fref = _midi_event(handle, frames, control_msb, 3);
-
 			break;
 		}
 		case Z_MAPPING_NOTE_PRESSURE:
 		{
-			const uint8_t note_pressure [3] = {
-				0xa0 | chn,
-				key,
-				eff_msb
-			};
-			if(fref)
-				fref = _midi_event(handle, frames, note_pressure, 3);
+			// 7-bit message, compare on 7-bit resolution
+			const uint8_t eff_msb = eff >> 7;
+
+			if(_cache_update(handle, &ref->pressure, eff_msb, handle->deadband >> 7, frames))
+			{
+				if(fref)
+					fref = _midi_note_pressure(handle, frames, chn, key, eff_msb);
+			}
 
 			break;
 		}
 		case Z_MAPPING_CHANNEL_PRESSURE:
 		{
-			const uint8_t channel_pressure [2] = {
-				0xd0 | chn,
-				eff_msb
-			};
-			if(fref)
-				fref = _midi_event(handle, frames, channel_pressure, 2);
+			// 7-bit message, compare on 7-bit resolution
+			const uint8_t eff_msb = eff >> 7;
+
+			if(_cache_update(handle, &chan->pressure, eff_msb, handle->deadband >> 7, frames))
+			{
+				if(fref)
+					fref = _midi_channel_pressure(handle, frames, chn, eff_msb);
+			}
 
 			break;
 		}
@@ -274,6 +484,53 @@ _midi_set(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 	return fref;
 }
 
+// send out values which have been held back by the minimum interval
+static inline LV2_Atom_Forge_Ref
+_midi_flush(handle_t *handle, int64_t frames)
+{
+	LV2_Atom_Forge_Ref fref = 1;
+
+	const int z_mapping = floor(*handle->z_mapping);
+
+	for(unsigned chn=0; chn<CHAN_MAX; chn++)
+	{
+		chan_t *chan = &handle->chan[chn];
+
+		if(_cache_flush(handle, &chan->bend, frames) && fref)
+			fref = _midi_bend(handle, frames, chn, chan->bend.val);
+
+		if(z_mapping == Z_MAPPING_CONTROL_CHANGE)
+		{
+			const uint8_t old_msb = chan->control.val >> 7;
+
+			if(_cache_flush(handle, &chan->control, frames) && fref)
+			{
+				const bool msb_changed = (chan->control.val >> 7) != old_msb;
+
+				fref = _midi_control(handle, frames, chn, chan->control.val, msb_changed);
+			}
+		}
+		else if(z_mapping == Z_MAPPING_CHANNEL_PRESSURE)
+		{
+			if(_cache_flush(handle, &chan->pressure, frames) && fref)
+				fref = _midi_channel_pressure(handle, frames, chn, chan->pressure.val);
+		}
+	}
+
+	if(z_mapping == Z_MAPPING_NOTE_PRESSURE)
+	{
+		uint32_t sid;
+		ref_t *ref;
+		CHIMAERA_DICT_FOREACH(handle->dict, sid, ref)
+		{
+			if(_cache_flush(handle, &ref->pressure, frames) && fref)
+				fref = _midi_note_pressure(handle, frames, ref->chn, ref->key, ref->pressure.val);
+		}
+	}
+
+	return fref;
+}
+
 static inline LV2_Atom_Forge_Ref
 _midi_idle(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 {
@@ -287,6 +544,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	handle_t *handle = (handle_t *)instance;
 
+	CHIMAERA_PROBE_RUN_ENTRY(CHIMAERA_MIDI_OUT_URI, nsamples, handle->event_in);
+
 	int n = *handle->sensors;
 	int oct = *handle->octave;
 
@@ -303,6 +562,25 @@ run(LV2_Handle instance, uint32_t nsamples)
 		handle->bot = oct*12.f - 0.5 - (n % 18 / 6.f);
 	}
 
+	const uint8_t ctrl = floor(*handle->controller);
+	if(ctrl != handle->ctrl)
+	{
+		handle->ctrl = ctrl;
+		for(unsigned i=0; i<CHAN_MAX; i++)
+			_cache_invalidate(&handle->chan[i].control);
+	}
+
+	handle->deadband = handle->deadband_in
+		? floor(*handle->deadband_in)
+		: 0;
+	handle->interval = handle->interval_in
+		? floor(*handle->interval_in * 1e-3 * handle->rate)
+		: 0;
+
+	// keep scheduling until the queue has drained after disabling it
+	const float bandwidth = handle->bandwidth ? *handle->bandwidth : 0.f;
+	handle->scheduled = (bandwidth > 0.f) || !midi_sched_is_empty(&handle->sched);
+
 	// prepare midi atom forge
 	const uint32_t capacity = handle->midi_out->atom.size;
 	LV2_Atom_Forge *forge = &handle->cforge.forge;
@@ -337,12 +615,37 @@ run(LV2_Handle instance, uint32_t nsamples)
 					break;
 			}
 		}
+		else if(chimaera_latency_check_type(&handle->cforge, &ev->body))
+		{
+			chimaera_latency_t lat;
+
+			chimaera_latency_deforge(&handle->cforge, &ev->body, &lat);
+			chimaera_latency_stats_add(&handle->latency_stats, &lat,
+				chimaera_latency_now());
+		}
 	}
 
+	if(ref && handle->interval)
+		ref = _midi_flush(handle, nsamples - 1);
+
+	if(ref && handle->scheduled)
+		ref = midi_sched_drain(&handle->sched, forge, handle->uris.midi_MidiEvent,
+			handle->stamp, nsamples, bandwidth);
+
 	if(ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
+		CHIMAERA_PROBE1(forge_overflow, CHIMAERA_MIDI_OUT_URI);
 		lv2_atom_sequence_clear(handle->midi_out);
+	}
+
+	chimaera_latency_stats_report(&handle->latency_stats, handle->latency_quant,
+		handle->latency_chain, handle->latency_max);
+
+	handle->stamp += nsamples;
+
+	CHIMAERA_PROBE_RUN_EXIT(CHIMAERA_MIDI_OUT_URI, handle->midi_out);
 }
 
 static void
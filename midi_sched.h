@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _MIDI_SCHED_H
+#define _MIDI_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <lv2/lv2plug.in/ns/ext/atom/forge.h>
+#include <lv2/lv2plug.in/ns/ext/midi/midi.h>
+
+#include <probe.h>
+
+// Bandwidth-limited MIDI output queue.
+//
+// Messages are pushed with their absolute frame time and drained once per
+// period, spaced out according to the configured byte rate of the link.
+// Note on/off and (N)RPN/data entry messages go into a FIFO which is always
+// served first. All other channel messages go into a second FIFO in which a
+// newer message for the same channel/controller/key replaces the value of the
+// still queued older one in place. Messages of other event types, e.g. UMPs,
+// pass the link without cost, but are queued nonetheless to keep the output
+// in time order. Note-offs are never dropped on overflow, as that would leave
+// notes hanging.
+
+#if !defined(MIDI_SCHED_SIZE)
+#	define MIDI_SCHED_SIZE 128
+#endif
+
+// slots of the first FIFO only note-offs may take, a note-on refused for lack
+// of room has its note-off swallowed, too
+#if !defined(MIDI_SCHED_RESERVE)
+#	define MIDI_SCHED_RESERVE 32
+#endif
+
+#define MIDI_SCHED_MSG_MAX 8
+
+typedef struct _midi_sched_msg_t midi_sched_msg_t;
+typedef struct _midi_sched_queue_t midi_sched_queue_t;
+typedef struct _midi_sched_t midi_sched_t;
+
+struct _midi_sched_msg_t {
+	uint64_t stamp;
+	LV2_URID type; // 0 for MIDI 1.0 messages
+	uint16_t key;
+	uint8_t status; // reported by the midi_emit probe
+	uint8_t len;
+	uint8_t buf [MIDI_SCHED_MSG_MAX];
+};
+
+// ring buffer of n messages starting at head
+struct _midi_sched_queue_t {
+	unsigned head;
+	unsigned n;
+	midi_sched_msg_t msg [MIDI_SCHED_SIZE];
+};
+
+struct _midi_sched_t {
+	double rate;
+	double next; // absolute frame time at which the link is free again
+	uint32_t dropped;
+	uint8_t refused [16][128/8]; // per channel and key, note-off still to swallow
+
+	midi_sched_queue_t hi;
+	midi_sched_queue_t lo;
+};
+
+static inline void
+midi_sched_reset(midi_sched_t *sched)
+{
+	sched->next = 0.0;
+	sched->dropped = 0;
+	memset(sched->refused, 0x0, sizeof(sched->refused));
+	sched->hi.head = sched->hi.n = 0;
+	sched->lo.head = sched->lo.n = 0;
+}
+
+static inline void
+midi_sched_init(midi_sched_t *sched, double rate)
+{
+	sched->rate = rate;
+	midi_sched_reset(sched);
+}
+
+static inline bool
+midi_sched_is_empty(const midi_sched_t *sched)
+{
+	return !sched->hi.n && !sched->lo.n;
+}
+
+static inline midi_sched_msg_t *
+_midi_sched_at(midi_sched_queue_t *queue, unsigned i)
+{
+	return &queue->msg[(queue->head + i) % MIDI_SCHED_SIZE];
+}
+
+static inline midi_sched_msg_t *
+_midi_sched_append(midi_sched_queue_t *queue)
+{
+	return _midi_sched_at(queue, queue->n++);
+}
+
+static inline void
+_midi_sched_pop(midi_sched_queue_t *queue)
+{
+	queue->head = (queue->head + 1) % MIDI_SCHED_SIZE;
+	queue->n -= 1;
+}
+
+// removes the i-th message, only done on overflow
+static inline void
+_midi_sched_remove(midi_sched_queue_t *queue, unsigned i)
+{
+	for(queue->n -= 1; i < queue->n; i++)
+		*_midi_sched_at(queue, i) = *_midi_sched_at(queue, i + 1);
+}
+
+static inline bool
+_midi_sched_is_note_on(const uint8_t *m, uint8_t len)
+{
+	return ((m[0] & 0xf0) == LV2_MIDI_MSG_NOTE_ON) && (len == 3) && m[2];
+}
+
+static inline bool
+_midi_sched_is_note_off(const uint8_t *m, uint8_t len)
+{
+	return (len == 3) && ( ((m[0] & 0xf0) == LV2_MIDI_MSG_NOTE_OFF)
+		|| ( ((m[0] & 0xf0) == LV2_MIDI_MSG_NOTE_ON) && !m[2]) );
+}
+
+static inline void
+_midi_sched_refuse(midi_sched_t *sched, const uint8_t *m)
+{
+	const uint8_t key = m[1] & 0x7f;
+
+	sched->refused[m[0] & 0x0f][key >> 3] |= 1 << (key & 0x7);
+}
+
+// returns whether the note-off belongs to a refused note-on, forgets it then
+static inline bool
+_midi_sched_swallow(midi_sched_t *sched, const uint8_t *m)
+{
+	const uint8_t key = m[1] & 0x7f;
+	uint8_t *bits = &sched->refused[m[0] & 0x0f][key >> 3];
+	const uint8_t mask = 1 << (key & 0x7);
+
+	if(!(*bits & mask))
+		return false;
+
+	*bits &= ~mask;
+	return true;
+}
+
+// makes room for a note-off by dropping the newest note-on still queued,
+// together with its note-off if that is queued as well
+static inline bool
+_midi_sched_evict(midi_sched_t *sched)
+{
+	midi_sched_queue_t *queue = &sched->hi;
+
+	for(unsigned i=queue->n; i-- > 0; )
+	{
+		const midi_sched_msg_t *msg = _midi_sched_at(queue, i);
+
+		if(msg->type || !_midi_sched_is_note_on(msg->buf, msg->len))
+			continue;
+
+		const uint8_t status = msg->buf[0];
+		const uint8_t note = msg->buf[1];
+		bool off_queued = false;
+
+		for(unsigned j=i+1; j<queue->n; j++)
+		{
+			const midi_sched_msg_t *off = _midi_sched_at(queue, j);
+
+			if(!off->type && _midi_sched_is_note_off(off->buf, off->len)
+				&& ((off->buf[0] & 0x0f) == (status & 0x0f)) && (off->buf[1] == note) )
+			{
+				_midi_sched_remove(queue, j);
+				off_queued = true;
+				break;
+			}
+		}
+
+		if(!off_queued)
+			_midi_sched_refuse(sched, msg->buf);
+		_midi_sched_remove(queue, i);
+
+		sched->dropped += 1;
+		CHIMAERA_PROBE2(midi_drop, status, sched->dropped);
+		return true;
+	}
+
+	return false;
+}
+
+// returns whether the message may be merged with previous ones of same key
+static inline bool
+_midi_sched_key(const uint8_t *m, uint8_t len, uint16_t *key)
+{
+	const uint8_t cmd = m[0] & 0xf0;
+
+	switch(cmd)
+	{
+		case LV2_MIDI_MSG_NOTE_PRESSURE:
+			*key = (m[0] << 8) | m[1];
+			return true;
+		case LV2_MIDI_MSG_CONTROLLER:
+			switch(m[1])
+			{
+				case LV2_MIDI_CTL_MSB_DATA_ENTRY:
+				case LV2_MIDI_CTL_MSB_DATA_ENTRY | 0x20:
+				case 0x60: // data increment
+				case 0x61: // data decrement
+				case 0x62: // NRPN LSB
+				case 0x63: // NRPN MSB
+				case LV2_MIDI_CTL_RPN_LSB:
+				case LV2_MIDI_CTL_RPN_MSB:
+					return false; // order matters
+				default:
+					*key = (m[0] << 8) | m[1];
+					return true;
+			}
+		case LV2_MIDI_MSG_CHANNEL_PRESSURE:
+		case LV2_MIDI_MSG_BENDER:
+			*key = m[0] << 8;
+			return true;
+		default:
+			return false; // note on/off, program change, system
+	}
+}
+
+// note-offs are never dropped, room for them is made at the expense of
+// note-ons if need be
+static inline bool
+midi_sched_push(midi_sched_t *sched, uint64_t stamp, const uint8_t *m,
+	uint8_t len)
+{
+	uint16_t key = 0;
+	midi_sched_queue_t *queue;
+	unsigned max = MIDI_SCHED_SIZE;
+
+	if(!len || (len > 3) )
+	{
+		sched->dropped += 1;
+		CHIMAERA_PROBE2(midi_drop, len ? m[0] : 0, sched->dropped);
+		return false;
+	}
+
+	const bool note_off = _midi_sched_is_note_off(m, len);
+	if(note_off && _midi_sched_swallow(sched, m))
+		return true; // its note-on never made it
+
+	if(_midi_sched_key(m, len, &key))
+	{
+		queue = &sched->lo;
+
+		// coalesce with a still queued message for same target
+		for(unsigned i=0; i<queue->n; i++)
+		{
+			midi_sched_msg_t *msg = _midi_sched_at(queue, i);
+
+			if(msg->key == key)
+			{
+				memcpy(msg->buf, m, len);
+				return true;
+			}
+		}
+	}
+	else
+	{
+		queue = &sched->hi;
+		if(!note_off)
+			max -= MIDI_SCHED_RESERVE;
+	}
+
+	if( (queue->n >= max) && !(note_off && _midi_sched_evict(sched)) )
+	{
+		if(_midi_sched_is_note_on(m, len))
+			_midi_sched_refuse(sched, m);
+
+		sched->dropped += 1;
+		CHIMAERA_PROBE2(midi_drop, m[0], sched->dropped);
+		return false;
+	}
+
+	midi_sched_msg_t *msg = _midi_sched_append(queue);
+	msg->stamp = stamp;
+	msg->type = 0;
+	msg->key = key;
+	msg->status = m[0];
+	msg->len = len;
+	memcpy(msg->buf, m, len);
+
+	return true;
+}
+
+// queues an event of another type behind the MIDI 1.0 messages of same time,
+// it is never coalesced, does not occupy the link and leaves the note-off
+// reserve alone
+static inline bool
+midi_sched_push_event(midi_sched_t *sched, uint64_t stamp, LV2_URID type,
+	uint8_t status, const void *m, uint8_t len)
+{
+	midi_sched_queue_t *queue = &sched->hi;
+
+	if( (len > MIDI_SCHED_MSG_MAX)
+		|| (queue->n >= MIDI_SCHED_SIZE - MIDI_SCHED_RESERVE) )
+	{
+		sched->dropped += 1;
+		CHIMAERA_PROBE2(midi_drop, status, sched->dropped);
+		return false;
+	}
+
+	midi_sched_msg_t *msg = _midi_sched_append(queue);
+	msg->stamp = stamp;
+	msg->type = type;
+	msg->key = 0;
+	msg->status = status;
+	msg->len = len;
+	memcpy(msg->buf, m, len);
+
+	return true;
+}
+
+// forge all messages due in the period [stamp, stamp + nsamples) at a link
+// speed of byte_rate bytes per second, 0 meaning unlimited
+static inline LV2_Atom_Forge_Ref
+midi_sched_drain(midi_sched_t *sched, LV2_Atom_Forge *forge, LV2_URID midi_event,
+	uint64_t stamp, uint32_t nsamples, float byte_rate)
+{
+	LV2_Atom_Forge_Ref ref = 1;
+
+	const double frames_per_byte = byte_rate > 0.f
+		? sched->rate / byte_rate
+		: 0.0;
+	const double end = stamp + nsamples;
+	double cur = sched->next > stamp ? sched->next : stamp;
+
+	while(ref && !midi_sched_is_empty(sched))
+	{
+		midi_sched_queue_t *hi = &sched->hi;
+		midi_sched_queue_t *lo = &sched->lo;
+
+		// queued messages are in time order, the earliest one is at the front
+		uint64_t ready = UINT64_MAX;
+		if(hi->n && (_midi_sched_at(hi, 0)->stamp < ready) )
+			ready = _midi_sched_at(hi, 0)->stamp;
+		if(lo->n && (_midi_sched_at(lo, 0)->stamp < ready) )
+			ready = _midi_sched_at(lo, 0)->stamp;
+
+		const double t = cur > ready ? cur : ready;
+		if(t >= end)
+			break; // link busy until next period
+
+		midi_sched_queue_t *queue = (hi->n && (_midi_sched_at(hi, 0)->stamp <= t)) ? hi : lo;
+		const midi_sched_msg_t *msg = _midi_sched_at(queue, 0);
+
+		ref = lv2_atom_forge_frame_time(forge, (int64_t)(t - stamp));
+		if(ref)
+			ref = lv2_atom_forge_atom(forge, msg->len, msg->type ? msg->type : midi_event);
+		if(ref)
+			ref = lv2_atom_forge_raw(forge, msg->buf, msg->len);
+		if(ref)
+		{
+			lv2_atom_forge_pad(forge, msg->len);
+			CHIMAERA_PROBE2(midi_emit, msg->status, msg->len);
+
+			cur = msg->type ? t : t + msg->len * frames_per_byte;
+			_midi_sched_pop(queue);
+		}
+	}
+
+	sched->next = cur;
+
+	return ref;
+}
+
+#endif // _MIDI_SCHED_H
@@ -109,6 +109,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	handle_t *handle = (handle_t *)instance;
 
+	CHIMAERA_PROBE_RUN_ENTRY(CHIMAERA_MOGRIFIER_URI, nsamples, handle->event_in);
+
 	// prepare osc atom forge
 	const uint32_t capacity = handle->event_out->atom.size;
 	LV2_Atom_Forge *forge = &handle->cforge.forge;
@@ -137,12 +139,26 @@ run(LV2_Handle instance, uint32_t nsamples)
 
 			ref = _chim_event(handle, frames, &cev);
 		}
+		else if(chimaera_latency_check_type(&handle->cforge, &ev->body) && ref)
+		{
+			chimaera_latency_t lat;
+
+			chimaera_latency_deforge(&handle->cforge, &ev->body, &lat);
+			ref = lv2_atom_forge_frame_time(forge, ev->time.frames);
+			if(ref)
+				ref = chimaera_latency_forge(&handle->cforge, &lat);
+		}
 	}
 
 	if(ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
+		CHIMAERA_PROBE1(forge_overflow, CHIMAERA_MOGRIFIER_URI);
 		lv2_atom_sequence_clear(handle->event_out);
+	}
+
+	CHIMAERA_PROBE_RUN_EXIT(CHIMAERA_MOGRIFIER_URI, handle->event_out);
 }
 
 static void
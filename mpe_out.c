@@ -20,18 +20,53 @@
 #include <math.h>
 
 #include <chimaera.h>
+#include <midi_sched.h>
 
 #define CHAN_MAX 16
 #define ZONE_MAX (CHAN_MAX / 2)
 
 typedef struct _zone_t zone_t;
 typedef struct _mpe_t mpe_t;
+typedef struct _chan_t chan_t;
 typedef struct _ref_t ref_t;
 typedef struct _handle_t handle_t;
 
+enum {
+	MODE_LEGACY = 0, // 14-bit sound controllers and mod wheel
+	MODE_MPE = 1, // channel pressure and CC74 as of the MPE specification
+	MODE_UMP = 2 // MIDI 2.0 per-note messages as universal midi packets
+};
+
+// LSB of timbre for 14-bit CC74, CC74 itself has no LSB pair in MIDI 1.0
+#define CTL_MPE_TIMBRE 0x4a
+#define CTL_MPE_TIMBRE_LSB 0x6a
+
+// MIDI 2.0 channel voice messages
+#define UMP_MT_CHANNEL_VOICE 0x4
+#define UMP_MSG_RPNC 0x00 // registered per-note controller
+#define UMP_RPNC_MODULATION 0x01
+#define UMP_RPNC_PITCH 0x03 // absolute pitch 7.25
+#define UMP_RPNC_TIMBRE 0x4a
+#define UMP_ATTR_PITCH 0x03 // absolute pitch 7.9
+
+// last values sent on a member channel, -1 if unknown
+struct _chan_t {
+	int32_t bend;
+	int32_t pressure;
+	int32_t timbre;
+	int32_t mod;
+};
+
 struct _ref_t {
+	uint8_t mode;
 	uint8_t chan;
 	uint8_t key;
+
+	// last values sent in UMP mode, -1 if unknown
+	int64_t pitch;
+	int64_t pressure;
+	int64_t timbre;
+	int64_t mod;
 };
 
 struct _zone_t {
@@ -50,6 +85,7 @@ struct _handle_t {
 	LV2_URID_Map *map;
 	struct {
 		LV2_URID midi_MidiEvent;
+		LV2_URID chim_UmpEvent;
 	} uris;
 	chimaera_forge_t cforge;
 
@@ -61,14 +97,30 @@ struct _handle_t {
 	int n;
 	int oct;
 
+	midi_sched_t sched;
+	bool scheduled;
+
 	const LV2_Atom_Sequence *event_in;
 	const float *sensors;
 	const float *octave;
 	const float *zones;
+	const float *bandwidth;
+	const float *mode;
+	const float *hires;
 	LV2_Atom_Sequence *midi_out;
+	float *latency_quant;
+	float *latency_chain;
+	float *latency_max;
 
 	uint8_t zon;
 	mpe_t mpe;
+	chan_t chan [CHAN_MAX];
+	uint32_t notes [CHAN_MAX][4]; // note numbers in use in UMP mode
+	int mod;
+	bool res;
+
+	uint64_t stamp;
+	chimaera_latency_stats_t latency_stats;
 };
 
 static void
@@ -165,8 +217,10 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 	}
 
 	handle->uris.midi_MidiEvent = handle->map->map(handle->map->handle, LV2_MIDI__MidiEvent);
+	handle->uris.chim_UmpEvent = handle->map->map(handle->map->handle, CHIMAERA_UMP_EVENT_URI);
 	chimaera_forge_init(&handle->cforge, handle->map);
 	CHIMAERA_DICT_INIT(handle->dict, handle->ref);
+	midi_sched_init(&handle->sched, rate);
 
 	return handle;
 }
@@ -193,17 +247,51 @@ connect_port(LV2_Handle instance, uint32_t port, void *data)
 		case 4:
 			handle->zones = (const float *)data;
 			break;
+		case 5:
+			handle->bandwidth = (const float *)data;
+			break;
+		case 6:
+			handle->mode = (const float *)data;
+			break;
+		case 7:
+			handle->hires = (const float *)data;
+			break;
+		case 8:
+			handle->latency_quant = (float *)data;
+			break;
+		case 9:
+			handle->latency_chain = (float *)data;
+			break;
+		case 10:
+			handle->latency_max = (float *)data;
+			break;
 		default:
 			break;
 	}
 }
 
+static inline void
+_chan_invalidate(chan_t *chan)
+{
+	chan->bend = -1;
+	chan->pressure = -1;
+	chan->timbre = -1;
+	chan->mod = -1;
+}
+
 static void
 activate(LV2_Handle instance)
 {
 	handle_t *handle = (handle_t *)instance;
 
+	for(unsigned i=0; i<CHAN_MAX; i++)
+		_chan_invalidate(&handle->chan[i]);
+	memset(handle->notes, 0x0, sizeof(handle->notes));
+
 	handle->zon = UINT8_MAX;
+	handle->mod = -1;
+	handle->stamp = 0;
+	midi_sched_reset(&handle->sched);
 }
 
 static inline LV2_Atom_Forge_Ref
@@ -211,6 +299,13 @@ _midi_event(handle_t *handle, int64_t frames, const uint8_t *m, size_t len)
 {
 	LV2_Atom_Forge *forge = &handle->cforge.forge;
 	LV2_Atom_Forge_Ref ref;
+
+	if(handle->scheduled)
+	{
+		// the scheduler forges it later, an overflow is not fatal to the sequence
+		midi_sched_push(&handle->sched, handle->stamp + frames, m, len);
+		return 1;
+	}
 		
 	ref = lv2_atom_forge_frame_time(forge, frames);
 	if(ref)
@@ -218,11 +313,164 @@ _midi_event(handle_t *handle, int64_t frames, const uint8_t *m, size_t len)
 	if(ref)
 		ref = lv2_atom_forge_raw(forge, m, len);
 	if(ref)
+	{
 		lv2_atom_forge_pad(forge, len);
+		CHIMAERA_PROBE2(midi_emit, m[0], len);
+	}
 
 	return ref;
 }
 
+// UMPs do not count against the scheduler's byte rate, which only applies to
+// MIDI 1.0 links, but go through its queue while it is active nonetheless, as
+// MIDI 1.0 messages still queued or forged alongside would be out of order
+static inline LV2_Atom_Forge_Ref
+_ump_event(handle_t *handle, int64_t frames, uint8_t status, uint8_t chan,
+	uint8_t note, uint8_t index, uint32_t data)
+{
+	LV2_Atom_Forge *forge = &handle->cforge.forge;
+	LV2_Atom_Forge_Ref ref;
+
+	const uint32_t m [2] = {
+		(UMP_MT_CHANNEL_VOICE << 28) | ((status | chan) << 16) | (note << 8) | index,
+		data
+	};
+
+	if(handle->scheduled)
+	{
+		midi_sched_push_event(&handle->sched, handle->stamp + frames,
+			handle->uris.chim_UmpEvent, status | chan, m, sizeof(m));
+		return 1;
+	}
+
+	ref = lv2_atom_forge_frame_time(forge, frames);
+	if(ref)
+		ref = lv2_atom_forge_atom(forge, sizeof(m), handle->uris.chim_UmpEvent);
+	if(ref)
+		ref = lv2_atom_forge_raw(forge, m, sizeof(m));
+	if(ref)
+	{
+		lv2_atom_forge_pad(forge, sizeof(m));
+		CHIMAERA_PROBE2(midi_emit, status | chan, sizeof(m));
+	}
+
+	return ref;
+}
+
+static inline uint32_t
+_ump_clip(double val)
+{
+	if(val < 0.0)
+		return 0;
+	if(val > UINT32_MAX)
+		return UINT32_MAX;
+	return val;
+}
+
+// the note number only identifies the note, its pitch is sent separately,
+// prefer the nearest key to please receivers ignoring the pitch attribute
+static inline uint8_t
+_ump_note_acquire(handle_t *handle, uint8_t chan, float val)
+{
+	uint32_t *notes = handle->notes[chan];
+	uint8_t note = val < 0.f ? 0 : (val > 0x7f ? 0x7f : floor(val + 0.5f));
+
+	for(unsigned i=0; i<0x80; i++, note = (note + 1) & 0x7f)
+	{
+		if(!(notes[note >> 5] & (1U << (note & 0x1f))))
+			break;
+	}
+
+	notes[note >> 5] |= 1U << (note & 0x1f);
+
+	return note;
+}
+
+static inline void
+_ump_note_release(handle_t *handle, uint8_t chan, uint8_t note)
+{
+	handle->notes[chan][note >> 5] &= ~(1U << (note & 0x1f));
+}
+
+static inline LV2_Atom_Forge_Ref
+_ump_on(handle_t *handle, int64_t frames, const chimaera_event_t *cev, ref_t *ref)
+{
+	const float val = handle->bot + cev->x * handle->ran;
+
+	// one channel per group, notes do not need channels of their own
+	const uint8_t chan = cev->gid % CHAN_MAX;
+	const uint8_t note = _ump_note_acquire(handle, chan, val);
+	const uint16_t vel = 0xffff;
+	const uint32_t p79 = _ump_clip(val * 0x200);
+	const uint32_t pitch = p79 > 0xffff ? 0xffff : p79; // 7.9
+
+	ref->mode = MODE_UMP;
+	ref->chan = chan;
+	ref->key = note;
+	ref->pitch = -1;
+	ref->pressure = -1;
+	ref->timbre = -1;
+	ref->mod = -1;
+
+	return _ump_event(handle, frames, LV2_MIDI_MSG_NOTE_ON, chan, note,
+		UMP_ATTR_PITCH, ((uint32_t)vel << 16) | pitch);
+}
+
+static inline LV2_Atom_Forge_Ref
+_ump_off(handle_t *handle, int64_t frames, ref_t *ref)
+{
+	const uint16_t vel = 0xffff;
+
+	_ump_note_release(handle, ref->chan, ref->key);
+
+	return _ump_event(handle, frames, LV2_MIDI_MSG_NOTE_OFF, ref->chan, ref->key,
+		0x0, (uint32_t)vel << 16);
+}
+
+static inline LV2_Atom_Forge_Ref
+_ump_control(handle_t *handle, int64_t frames, ref_t *ref, uint8_t status,
+	uint8_t index, int64_t *last, uint32_t val)
+{
+	if(*last == val)
+		return 1;
+	*last = val;
+
+	return _ump_event(handle, frames, status, ref->chan, ref->key, index, val);
+}
+
+static inline LV2_Atom_Forge_Ref
+_ump_set(handle_t *handle, int64_t frames, const chimaera_event_t *cev, ref_t *ref)
+{
+	LV2_Atom_Forge_Ref fref;
+
+	const float val = handle->bot + cev->x * handle->ran;
+
+	// absolute pitch, no bend range needed
+	const uint32_t pitch = _ump_clip(val * (double)(1 << 25));
+	fref = _ump_control(handle, frames, ref, UMP_MSG_RPNC, UMP_RPNC_PITCH,
+		&ref->pitch, pitch);
+
+	// pressure
+	const uint32_t z = _ump_clip(cev->z * (double)UINT32_MAX);
+	if(fref)
+		fref = _ump_control(handle, frames, ref, LV2_MIDI_MSG_NOTE_PRESSURE, 0x0,
+			&ref->pressure, z);
+
+	// timbre
+	const uint32_t vx = _ump_clip((cev->X * 0.5 + 0.5) * UINT32_MAX);
+	if(fref)
+		fref = _ump_control(handle, frames, ref, UMP_MSG_RPNC, UMP_RPNC_TIMBRE,
+			&ref->timbre, vx);
+
+	// modulation
+	const uint32_t vz = _ump_clip((cev->Z * 0.5 + 0.5) * UINT32_MAX);
+	if(fref)
+		fref = _ump_control(handle, frames, ref, UMP_MSG_RPNC, UMP_RPNC_MODULATION,
+			&ref->mod, vz);
+
+	return fref;
+}
+
 static inline LV2_Atom_Forge_Ref
 _midi_on(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 {
@@ -230,6 +478,9 @@ _midi_on(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 	if(!ref)
 		return 1;
 
+	if(handle->mod == MODE_UMP)
+		return _ump_on(handle, frames, cev, ref);
+
 	LV2_Atom_Forge_Ref fref;	
 	
 	const float val = handle->bot + cev->x * handle->ran;
@@ -245,9 +496,13 @@ _midi_on(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 	};
 	fref = _midi_event(handle, frames, note_on, 3);
 	
+	ref->mode = handle->mod;
 	ref->key = key;
 	ref->chan = chan;
 
+	// a new note on the channel always gets its initial expression
+	_chan_invalidate(&handle->chan[chan]);
+
 	return fref;
 }
 
@@ -258,6 +513,9 @@ _midi_off(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 	if(!ref)
 		return 1;
 
+	if(ref->mode == MODE_UMP)
+		return _ump_off(handle, frames, ref);
+
 	LV2_Atom_Forge_Ref fref;
 
 	const uint8_t chan = ref->chan;
@@ -276,6 +534,84 @@ _midi_off(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 	return fref;
 }
 
+static inline uint16_t
+_midi_clip(float val)
+{
+	if(val < 0.f)
+		return 0;
+	if(val > 0x3fff)
+		return 0x3fff;
+	return val;
+}
+
+// sends a 14-bit controller pair, LSB before MSB as legacy receivers expect it
+static inline LV2_Atom_Forge_Ref
+_midi_control_legacy(handle_t *handle, int64_t frames, uint8_t chan,
+	uint8_t ctrl_msb, uint8_t ctrl_lsb, int32_t *last, uint16_t val)
+{
+	LV2_Atom_Forge_Ref fref = 1;
+
+	if(*last == val)
+		return fref;
+	*last = val;
+
+	const uint8_t lsb [3] = {
+		LV2_MIDI_MSG_CONTROLLER | chan,
+		ctrl_lsb,
+		val & 0x7f
+	};
+
+	const uint8_t msb [3] = {
+		LV2_MIDI_MSG_CONTROLLER | chan,
+		ctrl_msb,
+		val >> 7
+	};
+
+	if(fref)
+		fref = _midi_event(handle, frames, lsb, 3);
+	if(fref)
+		fref = _midi_event(handle, frames, msb, 3);
+
+	return fref;
+}
+
+// sends a 7-bit controller or, if hires, a 14-bit pair where an unchanged MSB
+// is omitted
+static inline LV2_Atom_Forge_Ref
+_midi_control(handle_t *handle, int64_t frames, uint8_t chan,
+	uint8_t ctrl_msb, uint8_t ctrl_lsb, int32_t *last, uint16_t val, bool hires)
+{
+	LV2_Atom_Forge_Ref fref = 1;
+
+	if(!hires)
+		val &= 0x3f80; // compare at transmitted resolution
+
+	if(*last == val)
+		return fref;
+
+	const bool msb_changed = (*last < 0) || ((*last >> 7) != (val >> 7));
+	*last = val;
+
+	const uint8_t msb [3] = {
+		LV2_MIDI_MSG_CONTROLLER | chan,
+		ctrl_msb,
+		val >> 7
+	};
+
+	const uint8_t lsb [3] = {
+		LV2_MIDI_MSG_CONTROLLER | chan,
+		ctrl_lsb,
+		val & 0x7f
+	};
+
+	if(msb_changed)
+		fref = _midi_event(handle, frames, msb, 3);
+	if(fref && hires)
+		fref = _midi_event(handle, frames, lsb, 3);
+
+	return fref;
+}
+
 static inline LV2_Atom_Forge_Ref
 _midi_set(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 {
@@ -283,90 +619,78 @@ _midi_set(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 	if(!ref)
 		return 1;
 
-	LV2_Atom_Forge_Ref fref;
+	if(ref->mode == MODE_UMP)
+		return _ump_set(handle, frames, cev, ref);
+
+	LV2_Atom_Forge_Ref fref = 1;
 
 	const float val = handle->bot + cev->x * handle->ran;
 	
 	const uint8_t chan = ref->chan;
 	const uint8_t key = ref->key;
+	chan_t *last = &handle->chan[chan];
 
 	// bender
 	const uint16_t bnd = (val-key) * handle->ran_1 * 0x2000 + 0x1fff;
-	const uint8_t bnd_msb = bnd >> 7;
-	const uint8_t bnd_lsb = bnd & 0x7f;
-
-	const uint8_t bend [3] = {
-		LV2_MIDI_MSG_BENDER | chan,
-		bnd_lsb,
-		bnd_msb
-	};
-	fref = _midi_event(handle, frames, bend, 3);
 
-	// pressure
-	const uint16_t z = cev->z * 0x3fff;
-	const uint8_t z_msb = z >> 7;
-	const uint8_t z_lsb = z & 0x7f;
+	if(last->bend != bnd)
+	{
+		const uint8_t bend [3] = {
+			LV2_MIDI_MSG_BENDER | chan,
+			bnd & 0x7f,
+			bnd >> 7
+		};
+
+		fref = _midi_event(handle, frames, bend, 3);
+		last->bend = bnd;
+	}
 
-	const uint8_t pressure_lsb [3] = {
-		LV2_MIDI_MSG_CONTROLLER | chan,
-		LV2_MIDI_CTL_SC1_SOUND_VARIATION | 0x20,
-		z_lsb
-	};
+	const uint16_t z = _midi_clip(cev->z * 0x3fff);
+	const uint16_t vx = _midi_clip(cev->X * 0x2000 + 0x1fff);
 
-	const uint8_t pressure_msb [3] = {
-		LV2_MIDI_MSG_CONTROLLER | chan,
-		LV2_MIDI_CTL_SC1_SOUND_VARIATION,
-		z_msb
-	};
+	if(ref->mode == MODE_MPE)
+	{
+		// pressure
+		const uint8_t z_msb = z >> 7;
 
-	if(fref)
-		fref = _midi_event(handle, frames, pressure_lsb, 3);
-	if(fref)
-		fref = _midi_event(handle, frames, pressure_msb, 3);
+		if(fref && (last->pressure != z_msb) )
+		{
+			const uint8_t pressure [2] = {
+				LV2_MIDI_MSG_CHANNEL_PRESSURE | chan,
+				z_msb
+			};
 
-	// timbre
-	const uint16_t vx = (cev->X * 0x2000) + 0x1fff; //TODO limit
-	const uint8_t vx_msb = vx >> 7;
-	const uint8_t vx_lsb = vx & 0x7f;
+			fref = _midi_event(handle, frames, pressure, 2);
+			last->pressure = z_msb;
+		}
 
-	const uint8_t timbre_lsb [3] = {
-		LV2_MIDI_MSG_CONTROLLER | chan,
-		LV2_MIDI_CTL_SC5_BRIGHTNESS | 0x20,
-		vx_lsb
-	};
+		// timbre
+		if(fref)
+			fref = _midi_control(handle, frames, chan,
+				CTL_MPE_TIMBRE, CTL_MPE_TIMBRE_LSB, &last->timbre, vx, handle->res);
 
-	const uint8_t timbre_msb [3] = {
-		LV2_MIDI_MSG_CONTROLLER | chan,
-		LV2_MIDI_CTL_SC5_BRIGHTNESS,
-		vx_msb
-	};
+		return fref;
+	}
 
+	// pressure
 	if(fref)
-		fref = _midi_event(handle, frames, timbre_lsb, 3);
-	if(fref)
-		fref = _midi_event(handle, frames, timbre_msb, 3);
+		fref = _midi_control_legacy(handle, frames, chan,
+			LV2_MIDI_CTL_SC1_SOUND_VARIATION, LV2_MIDI_CTL_SC1_SOUND_VARIATION | 0x20,
+			&last->pressure, z);
 
 	// timbre
-	const uint16_t vz = (cev->Z * 0x2000) + 0x1fff; //TODO limit
-	const uint8_t vz_msb = vz >> 7;
-	const uint8_t vz_lsb = vz & 0x7f;
-
-	const uint8_t mod_lsb [3] = {
-		LV2_MIDI_MSG_CONTROLLER | chan,
-		LV2_MIDI_CTL_LSB_MODWHEEL,
-		vz_lsb
-	};
+	if(fref)
+		fref = _midi_control_legacy(handle, frames, chan,
+			LV2_MIDI_CTL_SC5_BRIGHTNESS, LV2_MIDI_CTL_SC5_BRIGHTNESS | 0x20,
+			&last->timbre, vx);
 
-	const uint8_t mod_msb [3] = {
-		LV2_MIDI_MSG_CONTROLLER | chan,
-		LV2_MIDI_CTL_MSB_MODWHEEL,
-		vz_msb
-	};
+	// modulation
+	const uint16_t vz = _midi_clip(cev->Z * 0x2000 + 0x1fff);
 
 	if(fref)
-		fref = _midi_event(handle, frames, mod_lsb, 3);
-	if(fref)
-		fref = _midi_event(handle, frames, mod_msb, 3);
+		fref = _midi_control_legacy(handle, frames, chan,
+			LV2_MIDI_CTL_MSB_MODWHEEL, LV2_MIDI_CTL_LSB_MODWHEEL,
+			&last->mod, vz);
 
 	return fref;
 }
@@ -377,6 +701,7 @@ _midi_idle(handle_t *handle, int64_t frames, const chimaera_event_t *cev)
 	LV2_Atom_Forge_Ref fref = 1;
 
 	chimaera_dict_clear(handle->dict);
+	memset(handle->notes, 0x0, sizeof(handle->notes));
 
 	return fref;
 }
@@ -387,6 +712,9 @@ _midi_init(handle_t *handle, int64_t frames)
 	LV2_Atom_Forge_Ref fref = 1;
 	mpe_t *mpe = &handle->mpe;
 
+	if(handle->mod == MODE_UMP)
+		return fref;
+
 	for(unsigned z=0; z<mpe->n_zones; z++)
 	{
 		zone_t *zone = &mpe->zones[z];
@@ -484,9 +812,17 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	handle_t *handle = (handle_t *)instance;
 
+	CHIMAERA_PROBE_RUN_ENTRY(CHIMAERA_MPE_OUT_URI, nsamples, handle->event_in);
+
 	int n = floor(*handle->sensors);
 	int oct = floor(*handle->octave);
 	uint8_t zones = floor(*handle->zones);
+	int mod = handle->mode ? floor(*handle->mode) : MODE_LEGACY;
+	bool res = handle->hires ? *handle->hires != 0.f : false;
+
+	// keep scheduling until the queue has drained after disabling it
+	const float bandwidth = handle->bandwidth ? *handle->bandwidth : 0.f;
+	handle->scheduled = (bandwidth > 0.f) || !midi_sched_is_empty(&handle->sched);
 
 	// prepare midi atom forge
 	const uint32_t capacity = handle->midi_out->atom.size;
@@ -496,6 +832,22 @@ run(LV2_Handle instance, uint32_t nsamples)
 	LV2_Atom_Forge_Ref ref;
 	ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
 
+	if( (mod != handle->mod) || (res != handle->res) )
+	{
+		// zone setup is not needed by UMP receivers, resend it when leaving UMP
+		const bool init = (handle->mod == MODE_UMP) && (mod != MODE_UMP);
+
+		handle->mod = mod;
+		handle->res = res;
+
+		// cached values were sent with a different encoding
+		for(unsigned i=0; i<CHAN_MAX; i++)
+			_chan_invalidate(&handle->chan[i]);
+
+		if(init)
+			_midi_init(handle, 0);
+	}
+
 	if(n != handle->n)
 	{
 		handle->n = n;
@@ -545,12 +897,34 @@ run(LV2_Handle instance, uint32_t nsamples)
 					break;
 			}
 		}
+		else if(chimaera_latency_check_type(&handle->cforge, &ev->body))
+		{
+			chimaera_latency_t lat;
+
+			chimaera_latency_deforge(&handle->cforge, &ev->body, &lat);
+			chimaera_latency_stats_add(&handle->latency_stats, &lat,
+				chimaera_latency_now());
+		}
 	}
 
+	if(ref && handle->scheduled)
+		ref = midi_sched_drain(&handle->sched, forge, handle->uris.midi_MidiEvent,
+			handle->stamp, nsamples, bandwidth);
+
 	if(ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
+		CHIMAERA_PROBE1(forge_overflow, CHIMAERA_MPE_OUT_URI);
 		lv2_atom_sequence_clear(handle->midi_out);
+	}
+
+	chimaera_latency_stats_report(&handle->latency_stats, handle->latency_quant,
+		handle->latency_chain, handle->latency_max);
+
+	handle->stamp += nsamples;
+
+	CHIMAERA_PROBE_RUN_EXIT(CHIMAERA_MPE_OUT_URI, handle->midi_out);
 }
 
 static void
@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <chimaera.h>
+#include <capture.h>
+#include <props.h>
+
+#define MAX_NPROPS 1
+#define PATH_SIZE 512
+#define SENSOR_MAX 160
+
+typedef enum _job_type_t job_type_t;
+typedef struct _job_t job_t;
+typedef struct _capture_map_t capture_map_t;
+typedef struct _plugstate_t plugstate_t;
+typedef struct _handle_t handle_t;
+
+enum _job_type_t {
+	JOB_OPEN	= 0,
+	JOB_UNMAP	= 1
+};
+
+// memory mapped capture, handed between worker and rt thread
+struct _capture_map_t {
+	const uint8_t *data;
+	size_t size;
+};
+
+struct _job_t {
+	job_type_t type;
+	union {
+		capture_map_t map;
+		char path [PATH_SIZE];
+	};
+};
+
+struct _plugstate_t {
+	char path [PATH_SIZE];
+};
+
+struct _handle_t {
+	LV2_URID_Map *map;
+	LV2_Worker_Schedule *sched;
+	chimaera_forge_t cforge;
+
+	PROPS_T(props, MAX_NPROPS);
+
+	plugstate_t state;
+	plugstate_t stash;
+
+	const LV2_Atom_Sequence *event_in;
+	LV2_Atom_Sequence *event_out;
+	const float *play;
+	const float *loop;
+
+	uint32_t rate;
+	bool path_dirty;
+
+	capture_map_t cap;
+	double ratio; // host to capture sample rate
+	const uint8_t *cur; // next record
+	uint64_t cap_frame; // capture frame of last record
+	double pos; // host frames since start of playback
+	int armed;
+	int playing;
+
+	int32_t values [SENSOR_MAX];
+};
+
+static void
+_path_cb(void *data, LV2_Atom_Forge *forge, int64_t frames,
+	props_event_t event, props_impl_t *impl)
+{
+	handle_t *handle = data;
+
+	handle->path_dirty = true;
+}
+
+static const props_def_t path_def = {
+	.label = "Path",
+	.property = CHIMAERA_URI"#player_path",
+	.access = LV2_PATCH__writable,
+	.type = LV2_ATOM__Path,
+	.mode = PROP_MODE_STATIC,
+	.event_mask = PROP_EVENT_WRITE,
+	.event_cb = _path_cb,
+	.max_size = PATH_SIZE
+};
+
+static LV2_State_Status
+_state_save(LV2_Handle instance, LV2_State_Store_Function store,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	handle_t *handle = instance;
+
+	return props_save(&handle->props, &handle->cforge.forge, store, state, flags, features);
+}
+
+static LV2_State_Status
+_state_restore(LV2_Handle instance, LV2_State_Retrieve_Function retrieve,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	handle_t *handle = instance;
+
+	return props_restore(&handle->props, &handle->cforge.forge, retrieve, state, flags, features);
+}
+
+static const LV2_State_Interface state_iface = {
+	.save = _state_save,
+	.restore = _state_restore
+};
+
+// non-rt, maps the whole capture and faults it in, so the rt thread won't
+static int
+_capture_map(const char *path, capture_map_t *cap)
+{
+	const int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return -1;
+
+	struct stat st;
+	if(fstat(fd, &st) || (st.st_size < (off_t)sizeof(capture_header_t)) )
+	{
+		close(fd);
+		return -1;
+	}
+
+	int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+	flags |= MAP_POPULATE;
+#endif
+	void *data = mmap(NULL, st.st_size, PROT_READ, flags, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED)
+		return -1;
+
+	if(!capture_header_check(data))
+	{
+		munmap(data, st.st_size);
+		return -1;
+	}
+
+	cap->data = data;
+	cap->size = st.st_size;
+
+	return 0;
+}
+
+// non-rt
+static LV2_Worker_Status
+_work(LV2_Handle instance, LV2_Worker_Respond_Function respond,
+	LV2_Worker_Respond_Handle target, uint32_t size, const void *body)
+{
+	const job_t *job = body;
+
+	switch(job->type)
+	{
+		case JOB_OPEN:
+		{
+			capture_map_t cap;
+
+			if(_capture_map(job->path, &cap))
+			{
+				fprintf(stderr, "%s: failed to map '%s'\n", CHIMAERA_PLAYER_URI, job->path);
+				break;
+			}
+
+			respond(target, sizeof(capture_map_t), &cap);
+			break;
+		}
+		case JOB_UNMAP:
+		{
+			munmap((void *)job->map.data, job->map.size);
+			break;
+		}
+	}
+
+	return LV2_WORKER_SUCCESS;
+}
+
+static void
+_rewind(handle_t *handle)
+{
+	handle->cur = handle->cap.data
+		? handle->cap.data + sizeof(capture_header_t)
+		: NULL;
+	handle->cap_frame = 0;
+	handle->pos = 0.0;
+}
+
+// rt-safe, swaps in new capture and hands old one back for unmapping
+static LV2_Worker_Status
+_work_response(LV2_Handle instance, uint32_t size, const void *body)
+{
+	handle_t *handle = instance;
+	const capture_map_t *cap = body;
+
+	if(handle->cap.data)
+	{
+		const job_t job = {
+			.type = JOB_UNMAP,
+			.map = handle->cap
+		};
+
+		handle->sched->schedule_work(handle->sched->handle, sizeof(job_t), &job);
+	}
+
+	handle->cap = *cap;
+
+	const capture_header_t *header = (const capture_header_t *)cap->data;
+	handle->ratio = header->rate
+		? (double)handle->rate / header->rate
+		: 1.0;
+	_rewind(handle);
+
+	return LV2_WORKER_SUCCESS;
+}
+
+static const LV2_Worker_Interface work_iface = {
+	.work = _work,
+	.work_response = _work_response,
+	.end_run = NULL
+};
+
+static LV2_Handle
+instantiate(const LV2_Descriptor* descriptor, double rate,
+	const char *bundle_path, const LV2_Feature *const *features)
+{
+	handle_t *handle = calloc(1, sizeof(handle_t));
+	if(!handle)
+		return NULL;
+
+	for(int i=0; features[i]; i++)
+	{
+		if(!strcmp(features[i]->URI, LV2_URID__map))
+			handle->map = (LV2_URID_Map *)features[i]->data;
+		else if(!strcmp(features[i]->URI, LV2_WORKER__schedule))
+			handle->sched = (LV2_Worker_Schedule *)features[i]->data;
+	}
+
+	if(!handle->map)
+	{
+		fprintf(stderr, "%s: Host does not support urid:map\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+	if(!handle->sched)
+	{
+		fprintf(stderr, "%s: Host does not support work:schedule\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
+	handle->rate = rate;
+	chimaera_forge_init(&handle->cforge, handle->map);
+
+	if(!props_init(&handle->props, MAX_NPROPS, descriptor->URI, handle->map, handle))
+	{
+		free(handle);
+		return NULL;
+	}
+
+	strcpy(handle->state.path, "/tmp/chimaera.cap");
+	if(!props_register(&handle->props, &path_def, handle->state.path, handle->stash.path))
+	{
+		free(handle);
+		return NULL;
+	}
+
+	handle->path_dirty = true; // map default capture on first run
+
+	return handle;
+}
+
+static void
+connect_port(LV2_Handle instance, uint32_t port, void *data)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	switch(port)
+	{
+		case 0:
+			handle->event_in = (const LV2_Atom_Sequence *)data;
+			break;
+		case 1:
+			handle->event_out = (LV2_Atom_Sequence *)data;
+			break;
+		case 2:
+			handle->play = (const float *)data;
+			break;
+		case 3:
+			handle->loop = (const float *)data;
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+activate(LV2_Handle instance)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	handle->armed = 0;
+	handle->playing = 0;
+}
+
+static LV2_Atom_Forge_Ref
+_idle(handle_t *handle, int64_t frames, LV2_Atom_Forge_Ref ref)
+{
+	LV2_Atom_Forge *forge = &handle->cforge.forge;
+	const chimaera_event_t cev = {
+		.state = CHIMAERA_STATE_IDLE
+	};
+
+	if(ref)
+		ref = lv2_atom_forge_frame_time(forge, frames);
+	if(ref)
+		ref = chimaera_event_forge(&handle->cforge, &cev);
+
+	return ref;
+}
+
+// forge all records due before frame offset 'until' of this period
+static LV2_Atom_Forge_Ref
+_play(handle_t *handle, int64_t until, LV2_Atom_Forge_Ref ref)
+{
+	LV2_Atom_Forge *forge = &handle->cforge.forge;
+	const uint8_t *end = handle->cap.data + handle->cap.size;
+
+	while(handle->playing && ref)
+	{
+		const uint8_t *next = handle->cur;
+		const capture_record_t *rec = capture_record_next(&next, end);
+		if(!rec)
+			break; // end of capture
+
+		const uint64_t cap_frame = handle->cap_frame + rec->delta;
+		int64_t frames = cap_frame * handle->ratio - handle->pos;
+		if(frames >= until)
+			break; // due in a later period
+		if(frames < 0)
+			frames = 0;
+
+		switch(rec->type)
+		{
+			case CAPTURE_TYPE_EVENT:
+			{
+				chimaera_event_t cev;
+				if(!capture_event_read(rec, &cev))
+					break; // skip malformed records
+
+				ref = lv2_atom_forge_frame_time(forge, frames);
+				if(ref)
+					ref = chimaera_event_forge(&handle->cforge, &cev);
+				break;
+			}
+			case CAPTURE_TYPE_DUMP:
+			{
+				const uint32_t sensors = capture_dump_read(rec, handle->values, SENSOR_MAX);
+
+				ref = lv2_atom_forge_frame_time(forge, frames);
+				if(ref)
+					ref = chimaera_dump_forge(&handle->cforge, handle->values, sensors);
+				break;
+			}
+			default:
+				break; // skip unknown records
+		}
+
+		handle->cur = next;
+		handle->cap_frame = cap_frame;
+	}
+
+	return ref;
+}
+
+static void
+run(LV2_Handle instance, uint32_t nsamples)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	CHIMAERA_PROBE_RUN_ENTRY(CHIMAERA_PLAYER_URI, nsamples, handle->event_in);
+
+	// prepare chimaera atom forge
+	const uint32_t capacity = handle->event_out->atom.size;
+	LV2_Atom_Forge *forge = &handle->cforge.forge;
+	lv2_atom_forge_set_buffer(forge, (uint8_t *)handle->event_out, capacity);
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+	ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	if(handle->path_dirty)
+	{
+		job_t job = {
+			.type = JOB_OPEN
+		};
+		strncpy(job.path, handle->state.path, PATH_SIZE - 1);
+
+		handle->sched->schedule_work(handle->sched->handle, sizeof(job_t), &job);
+		handle->path_dirty = false;
+	}
+
+	// start playback from the beginning on rising edge of play
+	const int play = *handle->play != 0.f;
+	if(play && !handle->armed && handle->cap.data)
+	{
+		_rewind(handle);
+		handle->playing = 1;
+	}
+	else if(!play && handle->playing)
+	{
+		ref = _idle(handle, 0, ref);
+		handle->playing = 0;
+	}
+	handle->armed = play && handle->cap.data;
+
+	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+		const int64_t frames = ev->time.frames;
+		const uint32_t len = ev->body.size;
+
+		if(chimaera_event_check_type(&handle->cforge, &obj->atom)
+			|| chimaera_dump_check_type(&handle->cforge, &obj->atom) )
+		{
+			// merge in time order with played back records
+			ref = _play(handle, frames, ref);
+
+			if(ref)
+				ref = lv2_atom_forge_frame_time(forge, frames);
+			if(ref)
+				ref = lv2_atom_forge_raw(forge, &ev->body, len + sizeof(LV2_Atom));
+			if(ref)
+				lv2_atom_forge_pad(forge, len);
+		}
+		else
+		{
+			props_advance(&handle->props, forge, frames, obj, &ref);
+		}
+	}
+
+	ref = _play(handle, nsamples, ref);
+
+	if(handle->playing)
+	{
+		handle->pos += nsamples;
+
+		const uint8_t *next = handle->cur;
+		if(!capture_record_next(&next, handle->cap.data + handle->cap.size))
+		{
+			// end of capture, release all blobs
+			ref = _idle(handle, nsamples ? nsamples - 1 : 0, ref);
+
+			if(*handle->loop != 0.f)
+				_rewind(handle);
+			else
+				handle->playing = 0;
+		}
+	}
+
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame);
+	else
+	{
+		CHIMAERA_PROBE1(forge_overflow, CHIMAERA_PLAYER_URI);
+		lv2_atom_sequence_clear(handle->event_out);
+	}
+
+	CHIMAERA_PROBE_RUN_EXIT(CHIMAERA_PLAYER_URI, handle->event_out);
+}
+
+static void
+deactivate(LV2_Handle instance)
+{
+	//handle_t *handle = (handle_t *)instance;
+	//nothing
+}
+
+static void
+cleanup(LV2_Handle instance)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	if(handle->cap.data)
+		munmap((void *)handle->cap.data, handle->cap.size);
+	free(handle);
+}
+
+static const void*
+extension_data(const char* uri)
+{
+	if(!strcmp(uri, LV2_STATE__interface))
+		return &state_iface;
+	else if(!strcmp(uri, LV2_WORKER__interface))
+		return &work_iface;
+
+	return NULL;
+}
+
+const LV2_Descriptor player = {
+	.URI						= CHIMAERA_PLAYER_URI,
+	.instantiate		= instantiate,
+	.connect_port		= connect_port,
+	.activate				= activate,
+	.run						= run,
+	.deactivate			= deactivate,
+	.cleanup				= cleanup,
+	.extension_data	= extension_data
+};
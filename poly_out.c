@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chimaera.h>
+
+#define VOICE_MAX 8
+#define VOICE_PORTS 8
+
+typedef struct _voice_t voice_t;
+typedef struct _handle_t handle_t;
+
+struct _voice_t {
+	float *gate;
+	float *sid;
+	float *north;
+	float *south;
+	float *x;
+	float *z;
+	float *X;
+	float *Z;
+
+	// latest state and arrival order, for blobs waiting for a voice with ports
+	chimaera_event_t cev;
+	uint32_t order;
+};
+
+struct _handle_t {
+	LV2_URID_Map *map;
+	chimaera_forge_t cforge;
+
+	chimaera_dict_t dict [CHIMAERA_DICT_SIZE];
+	voice_t voice [CHIMAERA_DICT_SIZE]; // only the first VOICE_MAX have ports
+	uint32_t order;
+
+	const LV2_Atom_Sequence *event_in;
+	LV2_Atom_Sequence *event_out;
+
+	int needs_clear;
+};
+
+static LV2_Handle
+instantiate(const LV2_Descriptor* descriptor, double rate,
+	const char *bundle_path, const LV2_Feature *const *features)
+{
+	int i;
+	handle_t *handle = calloc(1, sizeof(handle_t));
+	if(!handle)
+		return NULL;
+
+	for(i=0; features[i]; i++)
+		if(!strcmp(features[i]->URI, LV2_URID__map))
+			handle->map = (LV2_URID_Map *)features[i]->data;
+
+	if(!handle->map)
+	{
+		fprintf(stderr, "%s: Host does not support urid:map\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
+	chimaera_forge_init(&handle->cforge, handle->map);
+	CHIMAERA_DICT_INIT(handle->dict, handle->voice);
+
+	return handle;
+}
+
+static void
+connect_port(LV2_Handle instance, uint32_t port, void *data)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	switch(port)
+	{
+		case 0:
+			handle->event_in = (const LV2_Atom_Sequence *)data;
+			return;
+		case 1:
+			handle->event_out = (LV2_Atom_Sequence *)data;
+			return;
+		default:
+			break;
+	}
+
+	// voice banks start at port 2, VOICE_PORTS ports per bank
+	port -= 2;
+	const uint32_t v = port / VOICE_PORTS;
+	if(v >= VOICE_MAX)
+		return;
+
+	voice_t *voice = &handle->voice[v];
+
+	switch(port % VOICE_PORTS)
+	{
+		case 0:
+			voice->gate = (float *)data;
+			break;
+		case 1:
+			voice->sid = (float *)data;
+			break;
+		case 2:
+			voice->north = (float *)data;
+			break;
+		case 3:
+			voice->south = (float *)data;
+			break;
+		case 4:
+			voice->x = (float *)data;
+			break;
+		case 5:
+			voice->z = (float *)data;
+			break;
+		case 6:
+			voice->X = (float *)data;
+			break;
+		case 7:
+			voice->Z = (float *)data;
+			break;
+	}
+}
+
+static inline void
+_voice_clear(voice_t *voice)
+{
+	*voice->gate = 0.f;
+	*voice->sid = 0.f;
+	*voice->north = 0.f;
+	*voice->south = 0.f;
+	*voice->x = 0.f;
+	*voice->z = 0.f;
+	*voice->X = 0.f;
+	*voice->Z = 0.f;
+}
+
+static inline void
+_voice_set(voice_t *voice, const chimaera_event_t *cev)
+{
+	*voice->sid = cev->sid;
+	*voice->north = cev->pid & 0x80 ? 1.f : 0.f;
+	*voice->south = cev->pid & 0x100 ? 1.f : 0.f;
+	*voice->x = cev->x;
+	*voice->z = cev->z;
+	*voice->X = cev->X;
+	*voice->Z = cev->Z;
+}
+
+static inline int
+_voice_has_ports(handle_t *handle, voice_t *voice)
+{
+	return voice && (voice - handle->voice < VOICE_MAX);
+}
+
+// hands a freed voice with ports over to the longest waiting blob, if any,
+// by swapping the voices of their dict entries
+static inline void
+_voice_promote(handle_t *handle, voice_t *voice)
+{
+	chimaera_dict_t *waiting = NULL;
+	chimaera_dict_t *freed = NULL;
+
+	for(unsigned i=0; i<CHIMAERA_DICT_SIZE; i++)
+	{
+		chimaera_dict_t *entry = &handle->dict[i];
+		const voice_t *dst = entry->ref;
+
+		if(dst == voice)
+			freed = entry;
+		else if(entry->sid && !_voice_has_ports(handle, entry->ref)
+			&& (!waiting || ((int32_t)(dst->order - ((voice_t *)waiting->ref)->order) < 0)) )
+		{
+			waiting = entry;
+		}
+	}
+
+	if(!waiting || !freed)
+		return;
+
+	const voice_t *src = waiting->ref;
+
+	voice->cev = src->cev;
+	voice->order = src->order;
+	freed->ref = waiting->ref;
+	waiting->ref = voice;
+
+	*voice->gate = 1.f;
+	_voice_set(voice, &voice->cev);
+}
+
+// a new blob may land on a free dict entry without ports while another free
+// one still has them, thus swap their voices
+static inline voice_t *
+_voice_claim(handle_t *handle, uint32_t sid, voice_t *voice)
+{
+	chimaera_dict_t *own = NULL;
+	chimaera_dict_t *unused = NULL;
+
+	for(unsigned i=0; i<CHIMAERA_DICT_SIZE; i++)
+	{
+		chimaera_dict_t *entry = &handle->dict[i];
+
+		if(entry->sid == sid)
+			own = entry;
+		else if(!entry->sid && _voice_has_ports(handle, entry->ref))
+			unused = entry;
+	}
+
+	if(!own || !unused)
+		return voice;
+
+	voice_t *dst = unused->ref;
+
+	dst->cev = voice->cev;
+	dst->order = voice->order;
+	unused->ref = voice;
+	own->ref = dst;
+
+	return dst;
+}
+
+static void
+activate(LV2_Handle instance)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	// ports may not be connected yet, clear them in next run
+	handle->needs_clear = 1;
+}
+
+static void
+run(LV2_Handle instance, uint32_t nsamples)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	CHIMAERA_PROBE_RUN_ENTRY(CHIMAERA_POLY_OUT_URI, nsamples, handle->event_in);
+
+	// clone event_in to event_out
+	memcpy(handle->event_out, handle->event_in,
+		sizeof(LV2_Atom) + handle->event_in->atom.size);
+
+	if(handle->needs_clear)
+	{
+		chimaera_dict_clear(handle->dict);
+		for(unsigned v=0; v<VOICE_MAX; v++)
+			_voice_clear(&handle->voice[v]);
+		handle->needs_clear = 0;
+	}
+
+	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
+	{
+		if(chimaera_event_check_type(&handle->cforge, &ev->body))
+		{
+			chimaera_event_t cev;
+			voice_t *voice;
+
+			chimaera_event_deforge(&handle->cforge, &ev->body, &cev);
+
+			switch(cev.state)
+			{
+				case CHIMAERA_STATE_ON:
+					// a blob keeps its voice for its whole lifetime, blobs beyond
+					// VOICE_MAX wait for one to free up
+					voice = chimaera_dict_add(handle->dict, cev.sid);
+					if(voice)
+					{
+						voice->cev = cev;
+						voice->order = handle->order++;
+
+						if(!_voice_has_ports(handle, voice))
+							voice = _voice_claim(handle, cev.sid, voice);
+					}
+					if(_voice_has_ports(handle, voice))
+					{
+						*voice->gate = 1.f;
+						_voice_set(voice, &cev);
+					}
+					break;
+
+				case CHIMAERA_STATE_SET:
+					voice = chimaera_dict_ref(handle->dict, cev.sid);
+					if(voice)
+						voice->cev = cev;
+					if(_voice_has_ports(handle, voice))
+						_voice_set(voice, &cev);
+					break;
+
+				case CHIMAERA_STATE_OFF:
+					voice = chimaera_dict_del(handle->dict, cev.sid);
+					if(_voice_has_ports(handle, voice))
+					{
+						_voice_clear(voice);
+						_voice_promote(handle, voice);
+					}
+					break;
+
+				case CHIMAERA_STATE_IDLE:
+					chimaera_dict_clear(handle->dict);
+					for(unsigned v=0; v<VOICE_MAX; v++)
+						_voice_clear(&handle->voice[v]);
+					break;
+			}
+		}
+	}
+
+	CHIMAERA_PROBE_RUN_EXIT(CHIMAERA_POLY_OUT_URI, NULL);
+}
+
+static void
+deactivate(LV2_Handle instance)
+{
+	//handle_t *handle = (handle_t *)instance;
+	//nothing
+}
+
+static void
+cleanup(LV2_Handle instance)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	free(handle);
+}
+
+static const void*
+extension_data(const char* uri)
+{
+	return NULL;
+}
+
+const LV2_Descriptor poly_out = {
+	.URI						= CHIMAERA_POLY_OUT_URI,
+	.instantiate		= instantiate,
+	.connect_port		= connect_port,
+	.activate				= activate,
+	.run						= run,
+	.deactivate			= deactivate,
+	.cleanup				= cleanup,
+	.extension_data	= extension_data
+};
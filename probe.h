@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _PROBE_H
+#define _PROBE_H
+
+#include <stdint.h>
+
+#include <lv2/lv2plug.in/ns/ext/atom/util.h>
+
+// USDT tracepoints of provider 'chimaera'.
+//
+// With CHIMAERA_USDT defined, each probe compiles to a single nop plus an ELF
+// note, without it to nothing. Arguments that need to be computed, like the
+// event counts of run_entry and run_exit, are only evaluated while a tracer
+// is attached, which is signalled through the probe semaphores defined in
+// chimaera.c.
+//
+//   run_entry(const char *uri, uint32_t nsamples, uint32_t events_in)
+//   run_exit(const char *uri, uint32_t events_out)
+//   forge_overflow(const char *uri)
+//   dict_full(uint32_t sid)
+//   tuio2_frm(uint32_t fid, int32_t missed, int ignore)
+//   tuio2_alv(uint32_t fid, uint32_t blobs)
+//   midi_emit(uint8_t status, uint32_t size)
+//   midi_drop(uint8_t status, uint32_t dropped)
+//   osc_emit(uint32_t size)
+//
+// e.g. bpftrace -e 'usdt:chimaera.so:chimaera:forge_overflow { @[str(arg0)] = count(); }'
+
+#if defined(CHIMAERA_USDT)
+#	define _SDT_HAS_SEMAPHORES 1
+#	include <sys/sdt.h>
+
+#	define CHIMAERA_PROBE_SEMAPHORE(NAME) chimaera_ ## NAME ## _semaphore
+#	define CHIMAERA_PROBE_SEMAPHORE_DEFINE(NAME) \
+		unsigned short CHIMAERA_PROBE_SEMAPHORE(NAME) \
+			__attribute__((section(".probes"), used)) = 0
+#	define CHIMAERA_PROBE_ENABLED(NAME) \
+		__builtin_expect(CHIMAERA_PROBE_SEMAPHORE(NAME), 0)
+
+#	define CHIMAERA_PROBE0(NAME) \
+		DTRACE_PROBE(chimaera, NAME)
+#	define CHIMAERA_PROBE1(NAME, A) \
+		DTRACE_PROBE1(chimaera, NAME, A)
+#	define CHIMAERA_PROBE2(NAME, A, B) \
+		DTRACE_PROBE2(chimaera, NAME, A, B)
+#	define CHIMAERA_PROBE3(NAME, A, B, C) \
+		DTRACE_PROBE3(chimaera, NAME, A, B, C)
+
+extern unsigned short CHIMAERA_PROBE_SEMAPHORE(run_entry);
+extern unsigned short CHIMAERA_PROBE_SEMAPHORE(run_exit);
+extern unsigned short CHIMAERA_PROBE_SEMAPHORE(forge_overflow);
+extern unsigned short CHIMAERA_PROBE_SEMAPHORE(dict_full);
+extern unsigned short CHIMAERA_PROBE_SEMAPHORE(tuio2_frm);
+extern unsigned short CHIMAERA_PROBE_SEMAPHORE(tuio2_alv);
+extern unsigned short CHIMAERA_PROBE_SEMAPHORE(midi_emit);
+extern unsigned short CHIMAERA_PROBE_SEMAPHORE(midi_drop);
+extern unsigned short CHIMAERA_PROBE_SEMAPHORE(osc_emit);
+#else
+#	define CHIMAERA_PROBE_ENABLED(NAME) 0
+
+// arguments are type-checked, but never evaluated
+#	define CHIMAERA_PROBE0(NAME) do {} while(0)
+#	define CHIMAERA_PROBE1(NAME, A) do { if(0) { (void)(A); } } while(0)
+#	define CHIMAERA_PROBE2(NAME, A, B) do { if(0) { (void)(A); (void)(B); } } while(0)
+#	define CHIMAERA_PROBE3(NAME, A, B, C) do { if(0) { (void)(A); (void)(B); (void)(C); } } while(0)
+#endif
+
+static inline uint32_t
+chimaera_probe_count(const LV2_Atom_Sequence *seq)
+{
+	uint32_t n = 0;
+
+	if(seq)
+	{
+		LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+			n++;
+	}
+
+	return n;
+}
+
+#define CHIMAERA_PROBE_RUN_ENTRY(URI, NSAMPLES, SEQ) \
+	do { \
+		if(CHIMAERA_PROBE_ENABLED(run_entry)) \
+			CHIMAERA_PROBE3(run_entry, URI, NSAMPLES, chimaera_probe_count(SEQ)); \
+	} while(0)
+
+#define CHIMAERA_PROBE_RUN_EXIT(URI, SEQ) \
+	do { \
+		if(CHIMAERA_PROBE_ENABLED(run_exit)) \
+			CHIMAERA_PROBE2(run_exit, URI, chimaera_probe_count(SEQ)); \
+	} while(0)
+
+#endif // _PROBE_H
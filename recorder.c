@@ -0,0 +1,503 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chimaera.h>
+#include <capture.h>
+#include <props.h>
+
+#define MAX_NPROPS 1
+#define PATH_SIZE 512
+#define CHUNK_SIZE 2048 // max payload per worker job
+#define SENSOR_MAX 160
+
+typedef enum _job_type_t job_type_t;
+typedef struct _job_t job_t;
+typedef struct _plugstate_t plugstate_t;
+typedef struct _handle_t handle_t;
+
+enum _job_type_t {
+	JOB_OPEN	= 0,
+	JOB_DATA	= 1,
+	JOB_CLOSE	= 2
+};
+
+struct _job_t {
+	job_type_t type;
+	uint32_t size;
+	uint8_t body [0];
+};
+
+struct _plugstate_t {
+	char path [PATH_SIZE];
+};
+
+struct _handle_t {
+	LV2_URID_Map *map;
+	LV2_Worker_Schedule *sched;
+	chimaera_forge_t cforge;
+
+	PROPS_T(props, MAX_NPROPS);
+
+	plugstate_t state;
+	plugstate_t stash;
+
+	const LV2_Atom_Sequence *event_in;
+	LV2_Atom_Sequence *event_out;
+	const float *record;
+
+	uint32_t rate;
+	int recording;
+	bool closing; // last chunk still to be handed to the worker
+	bool path_dirty;
+	uint64_t frame; // frames since start of recording
+	uint64_t last; // frame of last record
+	uint32_t dropped; // records
+
+	// records accumulated on the rt thread, handed to the worker in chunks
+	union {
+		job_t job;
+		uint8_t buf [sizeof(job_t) + CHUNK_SIZE];
+	} chunk;
+
+	FILE *file; // only touched by worker
+};
+
+static void
+_path_cb(void *data, LV2_Atom_Forge *forge, int64_t frames,
+	props_event_t event, props_impl_t *impl)
+{
+	handle_t *handle = data;
+
+	handle->path_dirty = true;
+}
+
+static const props_def_t path_def = {
+	.label = "Path",
+	.property = CHIMAERA_URI"#recorder_path",
+	.access = LV2_PATCH__writable,
+	.type = LV2_ATOM__Path,
+	.mode = PROP_MODE_STATIC,
+	.event_mask = PROP_EVENT_WRITE,
+	.event_cb = _path_cb,
+	.max_size = PATH_SIZE
+};
+
+static LV2_State_Status
+_state_save(LV2_Handle instance, LV2_State_Store_Function store,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	handle_t *handle = instance;
+
+	return props_save(&handle->props, &handle->cforge.forge, store, state, flags, features);
+}
+
+static LV2_State_Status
+_state_restore(LV2_Handle instance, LV2_State_Retrieve_Function retrieve,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	handle_t *handle = instance;
+
+	return props_restore(&handle->props, &handle->cforge.forge, retrieve, state, flags, features);
+}
+
+static const LV2_State_Interface state_iface = {
+	.save = _state_save,
+	.restore = _state_restore
+};
+
+// non-rt
+static LV2_Worker_Status
+_work(LV2_Handle instance, LV2_Worker_Respond_Function respond,
+	LV2_Worker_Respond_Handle target, uint32_t size, const void *body)
+{
+	handle_t *handle = instance;
+	const job_t *job = body;
+
+	switch(job->type)
+	{
+		case JOB_OPEN:
+		{
+			if(handle->file)
+				fclose(handle->file);
+
+			handle->file = fopen((const char *)job->body, "wb");
+			if(handle->file)
+			{
+				capture_header_t header;
+				capture_header_init(&header, handle->rate);
+				fwrite(&header, sizeof(capture_header_t), 1, handle->file);
+			}
+			else
+			{
+				fprintf(stderr, "%s: failed to open '%s'\n", CHIMAERA_RECORDER_URI,
+					(const char *)job->body);
+			}
+
+			break;
+		}
+		case JOB_DATA:
+		{
+			if(handle->file)
+				fwrite(job->body, job->size, 1, handle->file);
+
+			break;
+		}
+		case JOB_CLOSE:
+		{
+			if(handle->file)
+			{
+				fclose(handle->file);
+				handle->file = NULL;
+			}
+
+			const uint32_t *dropped = (const uint32_t *)job->body;
+			if(*dropped) // records that did not fit while the host did not take chunks
+				fprintf(stderr, "%s: dropped %u records\n", CHIMAERA_RECORDER_URI, *dropped);
+
+			break;
+		}
+	}
+
+	return LV2_WORKER_SUCCESS;
+}
+
+// rt-safe
+static LV2_Worker_Status
+_work_response(LV2_Handle instance, uint32_t size, const void *body)
+{
+	return LV2_WORKER_SUCCESS;
+}
+
+static const LV2_Worker_Interface work_iface = {
+	.work = _work,
+	.work_response = _work_response,
+	.end_run = NULL
+};
+
+static LV2_Handle
+instantiate(const LV2_Descriptor* descriptor, double rate,
+	const char *bundle_path, const LV2_Feature *const *features)
+{
+	handle_t *handle = calloc(1, sizeof(handle_t));
+	if(!handle)
+		return NULL;
+
+	for(int i=0; features[i]; i++)
+	{
+		if(!strcmp(features[i]->URI, LV2_URID__map))
+			handle->map = (LV2_URID_Map *)features[i]->data;
+		else if(!strcmp(features[i]->URI, LV2_WORKER__schedule))
+			handle->sched = (LV2_Worker_Schedule *)features[i]->data;
+	}
+
+	if(!handle->map)
+	{
+		fprintf(stderr, "%s: Host does not support urid:map\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+	if(!handle->sched)
+	{
+		fprintf(stderr, "%s: Host does not support work:schedule\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
+	handle->rate = rate;
+	chimaera_forge_init(&handle->cforge, handle->map);
+
+	if(!props_init(&handle->props, MAX_NPROPS, descriptor->URI, handle->map, handle))
+	{
+		free(handle);
+		return NULL;
+	}
+
+	strcpy(handle->state.path, "/tmp/chimaera.cap");
+	if(!props_register(&handle->props, &path_def, handle->state.path, handle->stash.path))
+	{
+		free(handle);
+		return NULL;
+	}
+
+	return handle;
+}
+
+static void
+connect_port(LV2_Handle instance, uint32_t port, void *data)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	switch(port)
+	{
+		case 0:
+			handle->event_in = (const LV2_Atom_Sequence *)data;
+			break;
+		case 1:
+			handle->event_out = (LV2_Atom_Sequence *)data;
+			break;
+		case 2:
+			handle->record = (const float *)data;
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+activate(LV2_Handle instance)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	handle->recording = 0;
+	handle->closing = false;
+	handle->chunk.job.size = 0;
+}
+
+static void
+_schedule(handle_t *handle, job_type_t type, const void *body, uint32_t size)
+{
+	uint8_t buf [sizeof(job_t) + PATH_SIZE];
+	job_t *job = (job_t *)buf;
+
+	job->type = type;
+	job->size = size;
+	memcpy(job->body, body, size);
+
+	handle->sched->schedule_work(handle->sched->handle, sizeof(job_t) + size, job);
+}
+
+// returns whether the chunk is with the worker, it is kept for another try
+// in the next period otherwise
+static bool
+_chunk_flush(handle_t *handle)
+{
+	job_t *job = &handle->chunk.job;
+
+	if(!job->size)
+		return true;
+
+	job->type = JOB_DATA;
+	if(handle->sched->schedule_work(handle->sched->handle, sizeof(job_t) + job->size, job)
+			!= LV2_WORKER_SUCCESS)
+		return false;
+
+	job->size = 0;
+	return true;
+}
+
+// returns space for a record of given size, flushing the chunk if needed, or
+// NULL if the host does not take the full chunk. A dropped record must not
+// consume its delta, the next one spans the gap then.
+static inline uint8_t *
+_chunk_reserve(handle_t *handle, uint32_t size)
+{
+	job_t *job = &handle->chunk.job;
+
+	if( (job->size + size > CHUNK_SIZE) && !_chunk_flush(handle) )
+	{
+		handle->dropped += 1;
+		return NULL;
+	}
+
+	return job->body + job->size;
+}
+
+static inline uint32_t
+_delta(handle_t *handle, int64_t frames)
+{
+	const uint64_t abs = handle->frame + frames;
+	const uint64_t delta = abs - handle->last;
+
+	handle->last = abs;
+
+	return delta > UINT32_MAX ? UINT32_MAX : delta;
+}
+
+static void
+_start(handle_t *handle)
+{
+	_schedule(handle, JOB_OPEN, handle->state.path, strlen(handle->state.path) + 1);
+
+	handle->frame = 0;
+	handle->last = 0;
+	handle->dropped = 0;
+	handle->recording = 1;
+}
+
+// closes the file once the last chunk is with the worker
+static void
+_close(handle_t *handle)
+{
+	if(!handle->closing || !_chunk_flush(handle))
+		return;
+
+	_schedule(handle, JOB_CLOSE, &handle->dropped, sizeof(uint32_t));
+
+	handle->closing = false;
+}
+
+static void
+_stop(handle_t *handle)
+{
+	handle->recording = 0;
+	handle->closing = true;
+
+	_close(handle);
+}
+
+static void
+run(LV2_Handle instance, uint32_t nsamples)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	CHIMAERA_PROBE_RUN_ENTRY(CHIMAERA_RECORDER_URI, nsamples, handle->event_in);
+
+	// prepare chimaera atom forge
+	const uint32_t capacity = handle->event_out->atom.size;
+	LV2_Atom_Forge *forge = &handle->cforge.forge;
+	lv2_atom_forge_set_buffer(forge, (uint8_t *)handle->event_out, capacity);
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+	ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	const int record = *handle->record != 0.f;
+
+	if(handle->path_dirty)
+	{
+		if(handle->recording) // restart with new file
+			_stop(handle);
+		handle->path_dirty = false;
+	}
+
+	_close(handle); // retry a pending close
+
+	if(record && !handle->recording && !handle->closing)
+		_start(handle);
+	else if(!record && handle->recording)
+		_stop(handle);
+
+	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+		const int64_t frames = ev->time.frames;
+		const uint32_t len = ev->body.size;
+
+		if(chimaera_event_check_type(&handle->cforge, &obj->atom))
+		{
+			if(handle->recording)
+			{
+				chimaera_event_t cev;
+				chimaera_event_deforge(&handle->cforge, &obj->atom, &cev);
+
+				uint8_t *dst = _chunk_reserve(handle,
+					sizeof(capture_record_t) + sizeof(capture_event_t));
+				if(dst)
+					handle->chunk.job.size += capture_event_write(dst, _delta(handle, frames), &cev);
+			}
+		}
+		else if(chimaera_dump_check_type(&handle->cforge, &obj->atom))
+		{
+			if(handle->recording)
+			{
+				const chimaera_dump_t *dump = (const chimaera_dump_t *)obj;
+				uint32_t sensors = (dump->cobj.prop.value.size - sizeof(LV2_Atom_Vector_Body))
+					/ sizeof(int32_t);
+				if(sensors > SENSOR_MAX)
+					sensors = SENSOR_MAX;
+				const int32_t *values = chimaera_dump_deforge(&handle->cforge, &obj->atom, NULL);
+
+				uint8_t *dst = _chunk_reserve(handle, capture_dump_size(sensors));
+				if(dst)
+					handle->chunk.job.size += capture_dump_write(dst, _delta(handle, frames),
+						values, sensors);
+			}
+		}
+		else
+		{
+			props_advance(&handle->props, forge, frames, obj, &ref);
+			continue; // not to be cloned
+		}
+
+		// clone event
+		if(ref)
+			ref = lv2_atom_forge_frame_time(forge, frames);
+		if(ref)
+			ref = lv2_atom_forge_raw(forge, &ev->body, len + sizeof(LV2_Atom));
+		if(ref)
+			lv2_atom_forge_pad(forge, len);
+	}
+
+	if(handle->recording)
+	{
+		handle->frame += nsamples;
+		_chunk_flush(handle);
+	}
+
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame);
+	else
+	{
+		CHIMAERA_PROBE1(forge_overflow, CHIMAERA_RECORDER_URI);
+		lv2_atom_sequence_clear(handle->event_out);
+	}
+
+	CHIMAERA_PROBE_RUN_EXIT(CHIMAERA_RECORDER_URI, handle->event_out);
+}
+
+static void
+deactivate(LV2_Handle instance)
+{
+	//handle_t *handle = (handle_t *)instance;
+	//nothing
+}
+
+static void
+cleanup(LV2_Handle instance)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	if(handle->file)
+		fclose(handle->file);
+	free(handle);
+}
+
+static const void*
+extension_data(const char* uri)
+{
+	if(!strcmp(uri, LV2_STATE__interface))
+		return &state_iface;
+	else if(!strcmp(uri, LV2_WORKER__interface))
+		return &work_iface;
+
+	return NULL;
+}
+
+const LV2_Descriptor recorder = {
+	.URI						= CHIMAERA_RECORDER_URI,
+	.instantiate		= instantiate,
+	.connect_port		= connect_port,
+	.activate				= activate,
+	.run						= run,
+	.deactivate			= deactivate,
+	.cleanup				= cleanup,
+	.extension_data	= extension_data
+};
@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// LD_PRELOAD interposer flagging calls that are not realtime-safe.
+//
+// A host arms the calling thread with rtcheck_arm(1) right before a plugin's
+// run() and disarms it right after. Every allocation, lock, blocking or I/O
+// call made from an armed thread is counted as violation. The host looks up
+// the rtcheck_* symbols with dlsym(RTLD_DEFAULT, ...) and thus runs unchanged
+// without this library preloaded. With RTCHECK_ABORT set in the environment,
+// the first violation aborts, which gives a backtrace under a debugger.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#define EXPORT __attribute__((visibility("default")))
+#define POOL_SIZE 0x1000
+
+static __thread int armed;
+static atomic_uint violations = ATOMIC_VAR_INIT(0);
+static _Atomic(const char *) first = ATOMIC_VAR_INIT(NULL);
+static int abort_on_violation;
+
+// dlsym itself may allocate before the real allocator is resolved
+static uint8_t pool [POOL_SIZE] __attribute__((aligned(16)));
+static size_t pool_offset;
+static int resolving;
+
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+static int (*real_pthread_mutex_lock)(pthread_mutex_t *);
+static int (*real_pthread_mutex_unlock)(pthread_mutex_t *);
+static int (*real_pthread_cond_wait)(pthread_cond_t *, pthread_mutex_t *);
+static ssize_t (*real_write)(int, const void *, size_t);
+static ssize_t (*real_read)(int, void *, size_t);
+static int (*real_open)(const char *, int, ...);
+static int (*real_close)(int);
+static void *(*real_mmap)(void *, size_t, int, int, int, off_t);
+static int (*real_munmap)(void *, size_t);
+static int (*real_nanosleep)(const struct timespec *, struct timespec *);
+static int (*real_usleep)(useconds_t);
+static int (*real_sched_yield)(void);
+static int (*real_vfprintf)(FILE *, const char *, va_list);
+static size_t (*real_fwrite)(const void *, size_t, size_t, FILE *);
+static int (*real_fputs)(const char *, FILE *);
+static int (*real_fflush)(FILE *);
+
+EXPORT void rtcheck_arm(int state);
+EXPORT unsigned rtcheck_violations(void);
+EXPORT const char *rtcheck_first(void);
+EXPORT void rtcheck_reset(void);
+
+static void
+_resolve(void)
+{
+	resolving = 1;
+
+	real_malloc = dlsym(RTLD_NEXT, "malloc");
+	real_calloc = dlsym(RTLD_NEXT, "calloc");
+	real_realloc = dlsym(RTLD_NEXT, "realloc");
+	real_free = dlsym(RTLD_NEXT, "free");
+	real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+	real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+	real_pthread_mutex_lock = dlsym(RTLD_NEXT, "pthread_mutex_lock");
+	real_pthread_mutex_unlock = dlsym(RTLD_NEXT, "pthread_mutex_unlock");
+	real_pthread_cond_wait = dlsym(RTLD_NEXT, "pthread_cond_wait");
+	real_write = dlsym(RTLD_NEXT, "write");
+	real_read = dlsym(RTLD_NEXT, "read");
+	real_open = dlsym(RTLD_NEXT, "open");
+	real_close = dlsym(RTLD_NEXT, "close");
+	real_mmap = dlsym(RTLD_NEXT, "mmap");
+	real_munmap = dlsym(RTLD_NEXT, "munmap");
+	real_nanosleep = dlsym(RTLD_NEXT, "nanosleep");
+	real_usleep = dlsym(RTLD_NEXT, "usleep");
+	real_sched_yield = dlsym(RTLD_NEXT, "sched_yield");
+	real_vfprintf = dlsym(RTLD_NEXT, "vfprintf");
+	real_fwrite = dlsym(RTLD_NEXT, "fwrite");
+	real_fputs = dlsym(RTLD_NEXT, "fputs");
+	real_fflush = dlsym(RTLD_NEXT, "fflush");
+
+	resolving = 0;
+}
+
+__attribute__((constructor))
+static void
+_init(void)
+{
+	if(!real_malloc)
+		_resolve();
+
+	abort_on_violation = getenv("RTCHECK_ABORT") != NULL;
+}
+
+static void
+_violation(const char *name)
+{
+	const char *expected = NULL;
+
+	atomic_fetch_add_explicit(&violations, 1, memory_order_relaxed);
+	atomic_compare_exchange_strong(&first, &expected, name);
+
+	if(abort_on_violation)
+	{
+		armed = 0;
+		abort();
+	}
+}
+
+#define CHECK(NAME) \
+	do { \
+		if(!real_malloc && !resolving) \
+			_resolve(); \
+		if(armed) \
+			_violation(NAME); \
+	} while(0)
+
+static inline int
+_in_pool(const void *ptr)
+{
+	return ( (const uint8_t *)ptr >= pool) && ( (const uint8_t *)ptr < pool + POOL_SIZE);
+}
+
+static void *
+_pool_alloc(size_t size)
+{
+	size = (size + 15) & ~(size_t)15;
+	if(pool_offset + size > POOL_SIZE)
+		return NULL;
+
+	void *ptr = pool + pool_offset;
+	pool_offset += size;
+
+	return ptr; // static, thus zeroed
+}
+
+EXPORT void
+rtcheck_arm(int state)
+{
+	armed = state;
+}
+
+EXPORT unsigned
+rtcheck_violations(void)
+{
+	return atomic_load_explicit(&violations, memory_order_relaxed);
+}
+
+EXPORT const char *
+rtcheck_first(void)
+{
+	return atomic_load(&first);
+}
+
+EXPORT void
+rtcheck_reset(void)
+{
+	atomic_store(&violations, 0);
+	atomic_store(&first, NULL);
+}
+
+EXPORT void *
+malloc(size_t size)
+{
+	if(resolving)
+		return _pool_alloc(size);
+	CHECK("malloc");
+
+	return real_malloc(size);
+}
+
+EXPORT void *
+calloc(size_t nmemb, size_t size)
+{
+	if(resolving)
+		return _pool_alloc(nmemb * size);
+	CHECK("calloc");
+
+	return real_calloc(nmemb, size);
+}
+
+EXPORT void *
+realloc(void *ptr, size_t size)
+{
+	CHECK("realloc");
+
+	if(_in_pool(ptr))
+	{
+		const size_t avail = pool + POOL_SIZE - (uint8_t *)ptr;
+		void *dst = real_malloc(size);
+		if(dst)
+			memcpy(dst, ptr, size < avail ? size : avail);
+		return dst;
+	}
+
+	return real_realloc(ptr, size);
+}
+
+EXPORT void
+free(void *ptr)
+{
+	if(!ptr || _in_pool(ptr))
+		return;
+	CHECK("free");
+
+	real_free(ptr);
+}
+
+EXPORT int
+posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+	CHECK("posix_memalign");
+
+	return real_posix_memalign(ptr, alignment, size);
+}
+
+EXPORT void *
+aligned_alloc(size_t alignment, size_t size)
+{
+	CHECK("aligned_alloc");
+
+	return real_aligned_alloc(alignment, size);
+}
+
+EXPORT int
+pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+	CHECK("pthread_mutex_lock");
+
+	return real_pthread_mutex_lock(mutex);
+}
+
+EXPORT int
+pthread_mutex_unlock(pthread_mutex_t *mutex)
+{
+	CHECK("pthread_mutex_unlock");
+
+	return real_pthread_mutex_unlock(mutex);
+}
+
+EXPORT int
+pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+	CHECK("pthread_cond_wait");
+
+	return real_pthread_cond_wait(cond, mutex);
+}
+
+EXPORT ssize_t
+write(int fd, const void *buf, size_t count)
+{
+	CHECK("write");
+
+	return real_write(fd, buf, count);
+}
+
+EXPORT ssize_t
+read(int fd, void *buf, size_t count)
+{
+	CHECK("read");
+
+	return real_read(fd, buf, count);
+}
+
+EXPORT int
+open(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+
+	CHECK("open");
+
+	if(flags & O_CREAT)
+	{
+		va_list args;
+		va_start(args, flags);
+		mode = va_arg(args, mode_t);
+		va_end(args);
+	}
+
+	return real_open(path, flags, mode);
+}
+
+EXPORT int
+close(int fd)
+{
+	CHECK("close");
+
+	return real_close(fd);
+}
+
+EXPORT void *
+mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+	CHECK("mmap");
+
+	return real_mmap(addr, length, prot, flags, fd, offset);
+}
+
+EXPORT int
+munmap(void *addr, size_t length)
+{
+	CHECK("munmap");
+
+	return real_munmap(addr, length);
+}
+
+EXPORT int
+nanosleep(const struct timespec *req, struct timespec *rem)
+{
+	CHECK("nanosleep");
+
+	return real_nanosleep(req, rem);
+}
+
+EXPORT int
+usleep(useconds_t usec)
+{
+	CHECK("usleep");
+
+	return real_usleep(usec);
+}
+
+EXPORT int
+sched_yield(void)
+{
+	CHECK("sched_yield");
+
+	return real_sched_yield();
+}
+
+// stdio writes through libc-internal calls, thus is caught at its entry points
+
+EXPORT int
+vfprintf(FILE *stream, const char *fmt, va_list args)
+{
+	CHECK("vfprintf");
+
+	return real_vfprintf(stream, fmt, args);
+}
+
+EXPORT int
+fprintf(FILE *stream, const char *fmt, ...)
+{
+	va_list args;
+	int ret;
+
+	CHECK("fprintf");
+
+	va_start(args, fmt);
+	ret = real_vfprintf(stream, fmt, args);
+	va_end(args);
+
+	return ret;
+}
+
+EXPORT int
+printf(const char *fmt, ...)
+{
+	va_list args;
+	int ret;
+
+	CHECK("printf");
+
+	va_start(args, fmt);
+	ret = real_vfprintf(stdout, fmt, args);
+	va_end(args);
+
+	return ret;
+}
+
+EXPORT size_t
+fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream)
+{
+	CHECK("fwrite");
+
+	return real_fwrite(ptr, size, nmemb, stream);
+}
+
+EXPORT int
+fputs(const char *s, FILE *stream)
+{
+	CHECK("fputs");
+
+	return real_fputs(s, stream);
+}
+
+EXPORT int
+fflush(FILE *stream)
+{
+	CHECK("fflush");
+
+	return real_fflush(stream);
+}
@@ -21,8 +21,39 @@
 
 #include <chimaera.h>
 
+#define BLOB_MAX 64
+#define SENSOR_MAX 160
+#define VALUE_MAX 0x7ff
+#define KERNEL_N 5 // half width of a blob's footprint in sensors
+#define GEN_SID 0x80000000 // marks generated sids, disjoint from the UI's
+
+typedef enum _pattern_t pattern_t;
+typedef struct _blob_t blob_t;
 typedef struct _handle_t handle_t;
 
+enum _pattern_t {
+	PATTERN_WALK	= 0,
+	PATTERN_SWEEP	= 1,
+	PATTERN_TAP		= 2,
+	PATTERN_MIXED	= 3
+};
+
+// synthetic blob of the load generator
+struct _blob_t {
+	pattern_t kind;
+	uint32_t sid; // 0 while not touching
+	uint32_t pid;
+	int on;
+	float x;
+	float z;
+	float X;
+	float Z;
+	float phase;
+	float speed; // Hz
+	float t; // time in current tap phase
+	float dur; // duration of current tap phase
+};
+
 struct _handle_t {
 	LV2_URID_Map *map;
 	struct {
@@ -33,6 +64,26 @@ struct _handle_t {
 	const LV2_Atom_Sequence *event_in;
 	const float *sensors;
 	LV2_Atom_Sequence *event_out;
+	const float *generate;
+	const float *blobs;
+	const float *fps;
+	const float *pattern;
+	const float *seed;
+	const float *dump;
+
+	// load generator
+	uint32_t rate;
+	uint32_t cnt; // frames until next tick
+	uint32_t rng;
+	uint32_t sid;
+	uint32_t n_fwd; // blobs forwarded from the UI, currently touching
+	int running;
+	unsigned n;
+	pattern_t kind;
+	uint32_t seeded;
+	blob_t blob [BLOB_MAX];
+	float kernel [KERNEL_N];
+	int32_t values [SENSOR_MAX];
 };
 
 static LV2_Handle
@@ -59,6 +110,10 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		LV2_ATOM__eventTransfer);
 	chimaera_forge_init(&handle->cforge, handle->map);
 
+	handle->rate = rate;
+	for(unsigned k=0; k<KERNEL_N; k++)
+		handle->kernel[k] = expf(-0.5f * k*k);
+
 	return handle;
 }
 
@@ -78,6 +133,24 @@ connect_port(LV2_Handle instance, uint32_t port, void *data)
 		case 2:
 			handle->sensors = (const float *)data;
 			break;
+		case 3:
+			handle->generate = (const float *)data;
+			break;
+		case 4:
+			handle->blobs = (const float *)data;
+			break;
+		case 5:
+			handle->fps = (const float *)data;
+			break;
+		case 6:
+			handle->pattern = (const float *)data;
+			break;
+		case 7:
+			handle->seed = (const float *)data;
+			break;
+		case 8:
+			handle->dump = (const float *)data;
+			break;
 		default:
 			break;
 	}
@@ -86,8 +159,242 @@ connect_port(LV2_Handle instance, uint32_t port, void *data)
 static void
 activate(LV2_Handle instance)
 {
-	//handle_t *handle = (handle_t *)instance;
-	//nothing
+	handle_t *handle = (handle_t *)instance;
+
+	handle->running = 0;
+	handle->cnt = 0;
+}
+
+// xorshift32, deterministic for a given seed
+static inline float
+_rand(handle_t *handle)
+{
+	uint32_t x = handle->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	handle->rng = x;
+
+	return (x >> 8) * (1.f / 0x1000000);
+}
+
+static inline float
+_clip(float min, float val, float max)
+{
+	return val < min ? min : (val > max ? max : val);
+}
+
+static void
+_blob_init(handle_t *handle, blob_t *blob, unsigned i)
+{
+	blob->kind = handle->kind == PATTERN_MIXED ? i % 3 : handle->kind;
+	blob->sid = 0;
+	blob->pid = i & 1 ? 0x80 : 0x100;
+	blob->on = blob->kind != PATTERN_TAP;
+	blob->x = _rand(handle);
+	blob->z = 0.2f + 0.6f*_rand(handle);
+	blob->X = 0.f;
+	blob->Z = 0.f;
+	blob->phase = 2.f*M_PI * _rand(handle);
+	blob->speed = 0.1f + 0.9f*_rand(handle);
+	blob->t = 0.f;
+	blob->dur = 0.5f*_rand(handle); // taps start staggered
+}
+
+static void
+_blob_step(handle_t *handle, blob_t *blob, float dt)
+{
+	const float x = blob->x;
+	const float z = blob->z;
+
+	switch(blob->kind)
+	{
+		case PATTERN_WALK:
+		{
+			blob->x += 0.02f * (_rand(handle) - 0.5f);
+			if(blob->x < 0.f) // reflect
+				blob->x = -blob->x;
+			else if(blob->x > 1.f)
+				blob->x = 2.f - blob->x;
+			blob->z = _clip(0.05f, blob->z + 0.05f*(_rand(handle) - 0.5f), 1.f);
+			break;
+		}
+		case PATTERN_SWEEP:
+		{
+			blob->phase += 2.f*M_PI * blob->speed * dt;
+			if(blob->phase > 2.f*M_PI)
+				blob->phase -= 2.f*M_PI;
+			blob->x = 0.5f + 0.45f*sinf(blob->phase);
+			blob->z = 0.5f + 0.3f*sinf(0.5f*blob->phase);
+			break;
+		}
+		case PATTERN_TAP:
+		{
+			blob->t += dt;
+			if(blob->t >= blob->dur) // next phase
+			{
+				blob->on = !blob->on;
+				blob->t = 0.f;
+				blob->dur = blob->on
+					? 0.05f + 0.25f*_rand(handle) // touch
+					: 0.05f + 0.45f*_rand(handle); // gap
+				if(blob->on)
+					blob->x = _rand(handle);
+			}
+			// pressure envelope over touch duration
+			blob->z = blob->on ? sinf(M_PI * blob->t / blob->dur) : 0.f;
+			break;
+		}
+		default:
+			break;
+	}
+
+	blob->X = (blob->x - x) / dt;
+	blob->Z = (blob->z - z) / dt;
+}
+
+static LV2_Atom_Forge_Ref
+_gen_event(handle_t *handle, int64_t frames, chimaera_state_t state,
+	const blob_t *blob, LV2_Atom_Forge_Ref ref)
+{
+	LV2_Atom_Forge *forge = &handle->cforge.forge;
+	const chimaera_event_t cev = {
+		.state = state,
+		.sid = blob ? blob->sid : 0,
+		.gid = 0,
+		.pid = blob ? blob->pid : 0,
+		.x = blob ? blob->x : 0.f,
+		.z = blob ? blob->z : 0.f,
+		.X = blob ? blob->X : 0.f,
+		.Z = blob ? blob->Z : 0.f
+	};
+
+	if(ref)
+		ref = lv2_atom_forge_frame_time(forge, frames);
+	if(ref)
+		ref = chimaera_event_forge(&handle->cforge, &cev);
+
+	return ref;
+}
+
+// release all touching blobs
+static LV2_Atom_Forge_Ref
+_gen_stop(handle_t *handle, int64_t frames, LV2_Atom_Forge_Ref ref)
+{
+	for(unsigned i=0; i<handle->n; i++)
+	{
+		blob_t *blob = &handle->blob[i];
+
+		if(!blob->sid)
+			continue;
+
+		ref = _gen_event(handle, frames, CHIMAERA_STATE_OFF, blob, ref);
+		blob->sid = 0;
+	}
+
+	if(!handle->n_fwd)
+		ref = _gen_event(handle, frames, CHIMAERA_STATE_IDLE, NULL, ref);
+	handle->running = 0;
+
+	return ref;
+}
+
+static void
+_gen_start(handle_t *handle)
+{
+	handle->n = _clip(1, floor(*handle->blobs), BLOB_MAX);
+	handle->kind = _clip(PATTERN_WALK, floor(*handle->pattern), PATTERN_MIXED);
+	handle->seeded = floor(*handle->seed);
+	handle->rng = handle->seeded ? handle->seeded : 0x9e3779b9;
+	handle->sid = 0;
+	handle->cnt = 0;
+
+	for(unsigned i=0; i<handle->n; i++)
+		_blob_init(handle, &handle->blob[i], i);
+
+	handle->running = 1;
+}
+
+// sum of the blobs' footprints, north negative, south positive
+static LV2_Atom_Forge_Ref
+_gen_dump(handle_t *handle, int64_t frames, LV2_Atom_Forge_Ref ref)
+{
+	LV2_Atom_Forge *forge = &handle->cforge.forge;
+	const uint32_t sensors = _clip(1, floor(*handle->sensors), SENSOR_MAX);
+	int32_t *values = handle->values;
+
+	memset(values, 0x0, sensors * sizeof(int32_t));
+
+	for(unsigned i=0; i<handle->n; i++)
+	{
+		const blob_t *blob = &handle->blob[i];
+
+		if(!blob->on)
+			continue;
+
+		const int32_t amp = (blob->pid & 0x80 ? -VALUE_MAX : VALUE_MAX) * blob->z;
+		const int c = blob->x * (sensors - 1) + 0.5f;
+
+		for(int k=1-KERNEL_N; k<KERNEL_N; k++)
+		{
+			const int j = c + k;
+			if( (j >= 0) && (j < (int)sensors) )
+				values[j] += amp * handle->kernel[k < 0 ? -k : k];
+		}
+	}
+
+	for(unsigned j=0; j<sensors; j++)
+		values[j] = _clip(-VALUE_MAX, values[j], VALUE_MAX);
+
+	if(ref)
+		ref = lv2_atom_forge_frame_time(forge, frames);
+	if(ref)
+		ref = chimaera_dump_forge(&handle->cforge, values, sensors);
+
+	return ref;
+}
+
+static LV2_Atom_Forge_Ref
+_gen_tick(handle_t *handle, int64_t frames, float dt, LV2_Atom_Forge_Ref ref)
+{
+	unsigned active = 0;
+
+	for(unsigned i=0; i<handle->n; i++)
+	{
+		blob_t *blob = &handle->blob[i];
+
+		_blob_step(handle, blob, dt);
+
+		if(blob->on)
+		{
+			chimaera_state_t state = CHIMAERA_STATE_SET;
+			if(!blob->sid)
+			{
+				handle->sid = (handle->sid + 1) & ~GEN_SID;
+				if(!handle->sid)
+					handle->sid = 1;
+				blob->sid = GEN_SID | handle->sid;
+				state = CHIMAERA_STATE_ON;
+			}
+
+			ref = _gen_event(handle, frames, state, blob, ref);
+			active++;
+		}
+		else if(blob->sid)
+		{
+			ref = _gen_event(handle, frames, CHIMAERA_STATE_OFF, blob, ref);
+			blob->sid = 0;
+		}
+	}
+
+	// IDLE would clear the UI's blobs downstream, too
+	if(!active && !handle->n_fwd)
+		ref = _gen_event(handle, frames, CHIMAERA_STATE_IDLE, NULL, ref);
+
+	if(*handle->dump != 0.f)
+		ref = _gen_dump(handle, frames, ref);
+
+	return ref;
 }
 
 static void
@@ -95,6 +402,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	handle_t *handle = (handle_t *)instance;
 
+	CHIMAERA_PROBE_RUN_ENTRY(CHIMAERA_SIMULATOR_URI, nsamples, handle->event_in);
+
 	// prepare chimaera atom forge
 	const uint32_t capacity = handle->event_out->atom.size;
 	LV2_Atom_Forge *forge = &handle->cforge.forge;
@@ -102,6 +411,25 @@ run(LV2_Handle instance, uint32_t nsamples)
 	LV2_Atom_Forge_Frame frame;
 	LV2_Atom_Forge_Ref ref;
 	ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	// (re)start generator on configuration changes, same seed, same blobs
+	const int generate = *handle->generate != 0.f;
+	if(handle->running)
+	{
+		if(!generate
+			|| (handle->n != _clip(1, floor(*handle->blobs), BLOB_MAX))
+			|| (handle->kind != _clip(PATTERN_WALK, floor(*handle->pattern), PATTERN_MIXED))
+			|| (handle->seeded != (uint32_t)floor(*handle->seed)) )
+		{
+			ref = _gen_stop(handle, 0, ref);
+		}
+	}
+	if(generate && !handle->running)
+		_gen_start(handle);
+
+	const float fps = _clip(1.f, *handle->fps, 1000.f);
+	const uint32_t period = handle->rate > fps ? handle->rate / fps : 1;
+	const float dt = 1.f / fps;
 	
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
 	{
@@ -110,6 +438,28 @@ run(LV2_Handle instance, uint32_t nsamples)
 			int64_t frames = ev->time.frames;
 			size_t len = ev->body.size;
 
+			// generated ticks due before this event
+			for( ; handle->running && (handle->cnt < frames); handle->cnt += period)
+				ref = _gen_tick(handle, handle->cnt, dt, ref);
+
+			chimaera_event_t cev;
+			chimaera_event_deforge(&handle->cforge, &ev->body, &cev);
+			switch(cev.state)
+			{
+				case CHIMAERA_STATE_ON:
+					handle->n_fwd++;
+					break;
+				case CHIMAERA_STATE_OFF:
+					if(handle->n_fwd)
+						handle->n_fwd--;
+					break;
+				case CHIMAERA_STATE_IDLE:
+					handle->n_fwd = 0;
+					break;
+				default:
+					break;
+			}
+
 			// clone event
 			if(ref)
 				ref = lv2_atom_forge_frame_time(forge, frames);
@@ -120,10 +470,20 @@ run(LV2_Handle instance, uint32_t nsamples)
 		}
 	}
 
+	// remaining generated ticks of this period
+	for( ; handle->running && (handle->cnt < nsamples); handle->cnt += period)
+		ref = _gen_tick(handle, handle->cnt, dt, ref);
+	handle->cnt = handle->running ? handle->cnt - nsamples : 0;
+
 	if(ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
+		CHIMAERA_PROBE1(forge_overflow, CHIMAERA_SIMULATOR_URI);
 		lv2_atom_sequence_clear(handle->event_out);
+	}
+
+	CHIMAERA_PROBE_RUN_EXIT(CHIMAERA_SIMULATOR_URI, handle->event_out);
 }
 
 static void
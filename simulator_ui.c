@@ -23,7 +23,16 @@
 
 #include <lv2_eo_ui.h>
 
+#define TOUCH_MAX 10 // pointer plus multi-touch devices
+
 typedef struct _UI UI;
+typedef struct _touch_t touch_t;
+
+// pending state of a pointer, moves are written out coalesced
+struct _touch_t {
+	chimaera_event_t cev;
+	int dirty;
+};
 
 struct _UI {
 	eo_ui_t eoui;
@@ -40,8 +49,13 @@ struct _UI {
 	LV2UI_Port_Map *port_map;
 	uint32_t control_port;
 	uint32_t sensor_port;
+	uint32_t interval_port;
 
-	chimaera_event_t cev;
+	touch_t touch [TOUCH_MAX];
+	uint32_t sid;
+	float interval; // ms, 0: once per animator frame
+	Ecore_Animator *anim;
+	Ecore_Timer *timer;
 	
 	char theme_path[512];
 
@@ -85,24 +99,19 @@ _get_pos(UI *ui, Evas_Coord_Point *coord, float *dx, float *dz, float *dw)
 }
 
 static void
-_mouse_down(void *data, Evas *e, Evas_Object *obj, void *event_info)
+_touch_down(UI *ui, unsigned id, uint32_t pid, float x, float z)
 {
-	UI *ui = data;
-	Evas_Event_Mouse_Down *ev = event_info;
-	float x, z, w;
-
-	_get_pos(ui, &ev->canvas, &x, &z, &w);
-
-	Evas_Object *edj = elm_layout_edje_get(ui->theme);
-	edje_object_part_drag_value_set(edj, "magnet", x, 0.0);
-	edje_object_part_drag_size_set(edj, "magnet", w, z);
+	touch_t *touch = &ui->touch[id];
+	chimaera_event_t *cev = &touch->cev;
 
-	chimaera_event_t *cev = &ui->cev;
+	ui->sid = (ui->sid + 1) & 0x7fffffff; // high bit marks the plugin's generated sids
+	if(!ui->sid)
+		ui->sid = 1;
 
 	cev->state = CHIMAERA_STATE_ON;
-	cev->sid += 1;
+	cev->sid = ui->sid;
 	cev->gid = 0;
-	cev->pid = ev->button == 1 ? 128 : 256;
+	cev->pid = pid;
 	cev->x = x;
 	cev->z = z;
 	cev->X = 0.f;
@@ -111,20 +120,111 @@ _mouse_down(void *data, Evas *e, Evas_Object *obj, void *event_info)
 	_write_event(ui, cev);
 	
 	cev->state = CHIMAERA_STATE_SET;
+	touch->dirty = 0;
 }
 
 static void
-_mouse_up(void *data, Evas *e, Evas_Object *obj, void *event_info)
+_touch_up(UI *ui, unsigned id)
 {
-	UI *ui = data;
+	touch_t *touch = &ui->touch[id];
+	chimaera_event_t *cev = &touch->cev;
 
-	chimaera_event_t *cev = &ui->cev;
+	if(cev->state != CHIMAERA_STATE_SET)
+		return;
+
+	if(touch->dirty) // last position first
+		_write_event(ui, cev);
 	
 	cev->state = CHIMAERA_STATE_OFF;
 
 	_write_event(ui, cev);
 	
 	cev->state = CHIMAERA_STATE_IDLE;
+	touch->dirty = 0;
+}
+
+static void
+_touch_move(UI *ui, unsigned id, float x, float z)
+{
+	touch_t *touch = &ui->touch[id];
+	chimaera_event_t *cev = &touch->cev;
+
+	if(cev->state == CHIMAERA_STATE_SET)
+	{
+		cev->x = x;
+		cev->z = z;
+		touch->dirty = 1;
+	}
+}
+
+// write out latest position of moved pointers
+static Eina_Bool
+_flush(void *data)
+{
+	UI *ui = data;
+
+	for(unsigned id=0; id<TOUCH_MAX; id++)
+	{
+		touch_t *touch = &ui->touch[id];
+
+		if(!touch->dirty)
+			continue;
+
+		_write_event(ui, &touch->cev);
+		touch->dirty = 0;
+	}
+
+	return ECORE_CALLBACK_RENEW;
+}
+
+static void
+_flush_stop(UI *ui)
+{
+	if(ui->anim)
+	{
+		ecore_animator_del(ui->anim);
+		ui->anim = NULL;
+	}
+	if(ui->timer)
+	{
+		ecore_timer_del(ui->timer);
+		ui->timer = NULL;
+	}
+}
+
+static void
+_flush_start(UI *ui)
+{
+	_flush_stop(ui);
+
+	if(ui->interval > 0.f)
+		ui->timer = ecore_timer_add(ui->interval * 1e-3, _flush, ui);
+	else
+		ui->anim = ecore_animator_add(_flush, ui);
+}
+
+static void
+_mouse_down(void *data, Evas *e, Evas_Object *obj, void *event_info)
+{
+	UI *ui = data;
+	Evas_Event_Mouse_Down *ev = event_info;
+	float x, z, w;
+
+	_get_pos(ui, &ev->canvas, &x, &z, &w);
+
+	Evas_Object *edj = elm_layout_edje_get(ui->theme);
+	edje_object_part_drag_value_set(edj, "magnet", x, 0.0);
+	edje_object_part_drag_size_set(edj, "magnet", w, z);
+
+	_touch_down(ui, 0, ev->button == 1 ? 128 : 256, x, z);
+}
+
+static void
+_mouse_up(void *data, Evas *e, Evas_Object *obj, void *event_info)
+{
+	UI *ui = data;
+
+	_touch_up(ui, 0);
 }
 
 static void
@@ -139,16 +239,60 @@ _mouse_move(void *data, Evas *e, Evas_Object *obj, void *event_info)
 	Evas_Object *edj = elm_layout_edje_get(ui->theme);
 	edje_object_part_drag_value_set(edj, "magnet", x, 0.0);
 	edje_object_part_drag_size_set(edj, "magnet", w, z);
-	
-	chimaera_event_t *cev = &ui->cev;
 
-	if(cev->state == CHIMAERA_STATE_SET)
-	{
-		cev->x = x;
-		cev->z = z;
-		
-		_write_event(ui, cev);
-	}
+	_touch_move(ui, 0, x, z);
+}
+
+// additional touch points get their own sids, polarity alternates per device
+static void
+_multi_down(void *data, Evas *e, Evas_Object *obj, void *event_info)
+{
+	UI *ui = data;
+	Evas_Event_Multi_Down *ev = event_info;
+	Evas_Coord_Point coord = { .x = ev->canvas.x, .y = ev->canvas.y };
+	float x, z, w;
+
+	if( (ev->device <= 0) || (ev->device >= TOUCH_MAX) )
+		return;
+
+	_get_pos(ui, &coord, &x, &z, &w);
+	_touch_down(ui, ev->device, ev->device & 1 ? 256 : 128, x, z);
+}
+
+static void
+_multi_up(void *data, Evas *e, Evas_Object *obj, void *event_info)
+{
+	UI *ui = data;
+	Evas_Event_Multi_Up *ev = event_info;
+
+	if( (ev->device <= 0) || (ev->device >= TOUCH_MAX) )
+		return;
+
+	_touch_up(ui, ev->device);
+}
+
+static void
+_multi_move(void *data, Evas *e, Evas_Object *obj, void *event_info)
+{
+	UI *ui = data;
+	Evas_Event_Multi_Move *ev = event_info;
+	Evas_Coord_Point coord = { .x = ev->cur.canvas.x, .y = ev->cur.canvas.y };
+	float x, z, w;
+
+	if( (ev->device <= 0) || (ev->device >= TOUCH_MAX) )
+		return;
+
+	_get_pos(ui, &coord, &x, &z, &w);
+	_touch_move(ui, ev->device, x, z);
+}
+
+static void
+_content_del(void *data, Evas *e, Evas_Object *obj, void *event_info)
+{
+	UI *ui = data;
+
+	_flush_stop(ui);
+	ui->theme = NULL;
 }
 
 static void
@@ -180,12 +324,22 @@ _content_get(eo_ui_t *eoui)
 		EVAS_CALLBACK_MOUSE_UP, _mouse_up, ui);
 	evas_object_event_callback_add(ui->theme,
 		EVAS_CALLBACK_MOUSE_MOVE, _mouse_move, ui);
+	evas_object_event_callback_add(ui->theme,
+		EVAS_CALLBACK_MULTI_DOWN, _multi_down, ui);
+	evas_object_event_callback_add(ui->theme,
+		EVAS_CALLBACK_MULTI_UP, _multi_up, ui);
+	evas_object_event_callback_add(ui->theme,
+		EVAS_CALLBACK_MULTI_MOVE, _multi_move, ui);
 	evas_object_event_callback_add(ui->theme,
 		EVAS_CALLBACK_MOUSE_IN, _mouse_in, ui);
 	evas_object_event_callback_add(ui->theme,
 		EVAS_CALLBACK_MOUSE_OUT, _mouse_out, ui);
+	evas_object_event_callback_add(ui->theme,
+		EVAS_CALLBACK_DEL, _content_del, ui);
 	evas_object_pointer_mode_set(ui->theme, EVAS_OBJECT_POINTER_MODE_NOGRAB);
 
+	_flush_start(ui);
+
 	return ui->theme;
 }
 
@@ -249,6 +403,7 @@ instantiate(const LV2UI_Descriptor *descriptor,
 	// query port index of "control" port
 	ui->control_port = ui->port_map->port_index(ui->port_map->handle, "event_in");
 	ui->sensor_port = ui->port_map->port_index(ui->port_map->handle, "sensors");
+	ui->interval_port = ui->port_map->port_index(ui->port_map->handle, "interval");
 
 	ui->uris.event_transfer = ui->map->map(ui->map->handle, LV2_ATOM__eventTransfer);
 	chimaera_forge_init(&ui->cforge, ui->map);
@@ -269,6 +424,7 @@ cleanup(LV2UI_Handle handle)
 {
 	UI *ui = handle;
 
+	_flush_stop(ui);
 	eoui_cleanup(&ui->eoui);
 	free(ui);
 }
@@ -288,6 +444,17 @@ port_event(LV2UI_Handle handle, uint32_t i, uint32_t size, uint32_t urid,
 		sprintf(buf2, "%i", sensors);
 		elm_layout_signal_emit(ui->theme, buf2, CHIMAERA_SIMULATOR_UI_URI);
 	}
+	else if(i == ui->interval_port)
+	{
+		float interval = *(float *)buf;
+
+		if(interval != ui->interval)
+		{
+			ui->interval = interval;
+			if(ui->theme)
+				_flush_start(ui);
+		}
+	}
 }
 
 const LV2UI_Descriptor simulator_eo = {
@@ -17,6 +17,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <bsd/string.h>
 
 #include <chimaera.h>
@@ -27,16 +28,69 @@
 #define SYNTH_NAMES 8
 #define STRING_SIZE 256
 #define MAX_NPROPS (SYNTH_NAMES)
+#define TMPL_SIZE 1024
+#define ARG_NUM 4
+#define JAN_1970 2208988800ULL // seconds between NTP and Unix epoch
+#define BUS_NUM (1 + ARG_NUM) // gate + arguments per voice slot
+#define NODE_MAX 1024
+
+enum {
+	NODE_FREE = 0,
+	NODE_BUSY = 1,
+	NODE_HOLD = 2 // released, but synth may still be around
+};
+
+enum {
+	BUNDLE_NONE = 0,
+	BUNDLE_BLOCK = 1, // one bundle per period
+	BUNDLE_FRAME = 2 // one bundle per sensor frame
+};
 
 typedef struct _plugstate_t plugstate_t;
+typedef struct _tmpl_t tmpl_t;
+typedef struct _slot_t slot_t;
+typedef struct _node_t node_t;
+typedef struct _list_t list_t;
 typedef struct _handle_t handle_t;
 
 struct _plugstate_t {
 	char synth_name [STRING_SIZE][SYNTH_NAMES];
 };
 
+// pre-forged message, only its variable arguments are patched per event
+struct _tmpl_t {
+	union {
+		LV2_Atom atom;
+		uint8_t buf [TMPL_SIZE];
+	};
+	int32_t *id;
+	int32_t *pid;
+	float *arg [ARG_NUM];
+};
+
+// voice slot on a block of BUS_NUM consecutive control buses
+struct _slot_t {
+	float val [BUS_NUM];
+	bool dirty;
+};
+
+// node id slot, linked into a free list or into the hold list
+struct _node_t {
+	uint8_t state;
+	uint8_t gid;
+	int32_t prev;
+	int32_t next;
+	uint64_t stamp;
+};
+
+struct _list_t {
+	int32_t head;
+	int32_t tail;
+};
+
 struct _handle_t {
 	LV2_URID_Map *map;
+	osc_schedule_t *osc_sched;
 	chimaera_forge_t cforge;
 	osc_forge_t oforge;
 	LV2_Atom_Forge forge;
@@ -56,12 +110,66 @@ struct _handle_t {
 	const float *allocate;
 	const float *gate;
 	const float *group;
+	const float *bundle;
+	const float *latency;
+	const float *bus;
+	const float *bus_offset;
+	const float *hold;
+	const LV2_Atom_Sequence *osc_in;
+	float *latency_quant;
+	float *latency_chain;
+	float *latency_max;
+
+	double rate;
+	uint64_t t0; // NTP time of the current period without osc:schedule
+	int i_bundle;
+	double i_latency; // in frames
+	bool bundle_open;
+	int64_t bundle_frames;
+	LV2_Atom_Forge_Frame bundle_frame [2];
 
 	int i_allocate;
 	int i_gate;
 	int i_group;
+
+	// port values and synth names the templates were built with
+	bool dirty;
+	int32_t i_out_offset;
+	int32_t i_gid_offset;
+	int32_t i_arg_offset;
+	int t_allocate;
+	int t_gate;
+
+	int i_bus;
+	bool bus_dirty;
+	chimaera_dict_t dict [CHIMAERA_DICT_SIZE];
+	slot_t slot [CHIMAERA_DICT_SIZE];
+
+	// node id pool of size sid_wrap, recycled least recently released first
+	uint64_t stamp;
+	int32_t n_nodes;
+	node_t node [NODE_MAX];
+	list_t free_list [SYNTH_NAMES];
+	list_t hold_list;
+	chimaera_dict_t node_dict [CHIMAERA_DICT_SIZE];
+	int32_t node_ref [CHIMAERA_DICT_SIZE];
+
+	tmpl_t s_new [SYNTH_NAMES];
+	tmpl_t n_set [2]; // gate off, gate on
+	tmpl_t n_setn;
+
+	chimaera_latency_stats_t latency_stats;
 };
 
+static void
+_synth_name_cb(void *data, LV2_Atom_Forge *forge, int64_t frames,
+	props_event_t event, props_impl_t *impl)
+{
+	handle_t *handle = data;
+
+	handle->dirty = true;
+}
+
 #define SYNTH_NAME(NUM) \
 { \
 	.label = "Synth Name "#NUM, \
@@ -69,6 +177,8 @@ struct _handle_t {
 	.access = LV2_PATCH__writable, \
 	.type = LV2_ATOM__String, \
 	.mode = PROP_MODE_STATIC, \
+	.event_mask = PROP_EVENT_WRITE, \
+	.event_cb = _synth_name_cb, \
 	.max_size = STRING_SIZE \
 }
 
@@ -117,8 +227,12 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 
 	for(int i=0; features[i]; i++)
+	{
 		if(!strcmp(features[i]->URI, LV2_URID__map))
 			handle->map = (LV2_URID_Map *)features[i]->data;
+		else if(!strcmp(features[i]->URI, OSC__schedule))
+			handle->osc_sched = (osc_schedule_t *)features[i]->data;
+	}
 
 	if(!handle->map)
 	{
@@ -127,6 +241,10 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->rate = rate;
+	CHIMAERA_DICT_INIT(handle->dict, handle->slot);
+	CHIMAERA_DICT_INIT(handle->node_dict, handle->node_ref);
+
 	osc_forge_init(&handle->oforge, handle->map);
 	chimaera_forge_init(&handle->cforge, handle->map);
 	lv2_atom_forge_init(&handle->forge, handle->map);
@@ -192,108 +310,530 @@ connect_port(LV2_Handle instance, uint32_t port, void *data)
 		case 9:
 			handle->group = (const float *)data;
 			break;
+		case 10:
+			handle->bundle = (const float *)data;
+			break;
+		case 11:
+			handle->latency = (const float *)data;
+			break;
+		case 12:
+			handle->bus = (const float *)data;
+			break;
+		case 13:
+			handle->bus_offset = (const float *)data;
+			break;
+		case 14:
+			handle->hold = (const float *)data;
+			break;
+		case 15:
+			handle->osc_in = (const LV2_Atom_Sequence *)data;
+			break;
+		case 16:
+			handle->latency_quant = (float *)data;
+			break;
+		case 17:
+			handle->latency_chain = (float *)data;
+			break;
+		case 18:
+			handle->latency_max = (float *)data;
+			break;
 
 		default:
 			break;
 	}
 }
 
+static inline void
+_list_push(handle_t *handle, list_t *list, int32_t idx)
+{
+	node_t *node = &handle->node[idx];
+
+	node->prev = list->tail;
+	node->next = -1;
+
+	if(list->tail >= 0)
+		handle->node[list->tail].next = idx;
+	else
+		list->head = idx;
+	list->tail = idx;
+}
+
+static inline void
+_list_remove(handle_t *handle, list_t *list, int32_t idx)
+{
+	node_t *node = &handle->node[idx];
+
+	if(node->prev >= 0)
+		handle->node[node->prev].next = node->next;
+	else
+		list->head = node->next;
+
+	if(node->next >= 0)
+		handle->node[node->next].prev = node->prev;
+	else
+		list->tail = node->prev;
+}
+
+// distribute the ids in contiguous ranges over the groups' free lists,
+// released ids still in range stay on hold in their release order, sounding
+// nodes have to be released beforehand
+static void
+_pool_reset(handle_t *handle, int32_t n_nodes)
+{
+	int32_t idx = handle->n_nodes ? handle->hold_list.head : -1;
+
+	handle->n_nodes = n_nodes;
+
+	for(unsigned g=0; g<SYNTH_NAMES; g++)
+		handle->free_list[g].head = handle->free_list[g].tail = -1;
+	handle->hold_list.head = handle->hold_list.tail = -1;
+
+	while(idx >= 0)
+	{
+		const int32_t next = handle->node[idx].next;
+
+		if(idx < n_nodes)
+			_list_push(handle, &handle->hold_list, idx);
+		else
+			handle->node[idx].state = NODE_FREE;
+
+		idx = next;
+	}
+
+	for(int32_t i=0; i<n_nodes; i++)
+	{
+		node_t *node = &handle->node[i];
+		const unsigned g = i * SYNTH_NAMES / n_nodes;
+
+		if(node->state == NODE_HOLD)
+			continue;
+
+		node->state = NODE_FREE;
+		node->gid = g;
+		_list_push(handle, &handle->free_list[g], i);
+	}
+
+	chimaera_dict_clear(handle->node_dict);
+}
+
+static inline void
+_pool_free(handle_t *handle, int32_t idx)
+{
+	node_t *node = &handle->node[idx];
+
+	_list_remove(handle, &handle->hold_list, idx);
+	node->state = NODE_FREE;
+	_list_push(handle, &handle->free_list[node->gid], idx);
+}
+
+static int32_t
+_pool_alloc(handle_t *handle, uint8_t gid)
+{
+	int32_t idx = -1;
+	list_t *list;
+
+	// prefer ids last used by the same group, then the ones of other groups
+	for(unsigned g=0; (g<SYNTH_NAMES) && (idx < 0); g++)
+	{
+		list = &handle->free_list[(gid + g) % SYNTH_NAMES];
+		if( (idx = list->head) >= 0)
+			_list_remove(handle, list, idx);
+	}
+
+	// pool exhausted, reuse the node released the longest time ago
+	if( (idx < 0) && ((idx = handle->hold_list.head) >= 0) )
+		_list_remove(handle, &handle->hold_list, idx);
+
+	if(idx >= 0)
+	{
+		node_t *node = &handle->node[idx];
+
+		node->state = NODE_BUSY;
+		node->gid = gid % SYNTH_NAMES;
+	}
+
+	return idx;
+}
+
+static inline void
+_pool_release(handle_t *handle, int32_t idx)
+{
+	node_t *node = &handle->node[idx];
+
+	if(node->state != NODE_BUSY)
+		return;
+
+	node->state = NODE_HOLD;
+	node->stamp = handle->stamp;
+	_list_push(handle, &handle->hold_list, idx);
+}
+
+// the hold list is in release order, thus expires from its head
+static inline void
+_pool_expire(handle_t *handle, uint64_t hold)
+{
+	int32_t idx;
+
+	while( ((idx = handle->hold_list.head) >= 0)
+		&& (handle->stamp >= handle->node[idx].stamp + hold) )
+	{
+		_pool_free(handle, idx);
+	}
+}
+
+static void
+_osc_in_message(const char *path, const char *fmt,
+	const LV2_Atom_Tuple *arguments, void *data)
+{
+	handle_t *handle = data;
+	int32_t id;
+
+	if(!path || strcmp(path, "/n_end") || !arguments)
+		return;
+
+	if(!osc_deforge_int32(&handle->oforge, &handle->forge,
+			lv2_atom_tuple_begin(arguments), &id))
+		return;
+
+	const int32_t idx = id - (int32_t)floor(*handle->sid_offset);
+	if( (idx >= 0) && (idx < handle->n_nodes)
+		&& (handle->node[idx].state == NODE_HOLD) )
+	{
+		_pool_free(handle, idx); // synth is gone, no need to wait any longer
+	}
+}
+
 static void
 activate(LV2_Handle instance)
 {
-	//handle_t *handle = (handle_t *)instance;
-	//nothing
+	handle_t *handle = (handle_t *)instance;
+
+	handle->dirty = true;
+
+	chimaera_dict_clear(handle->dict);
+	memset(handle->slot, 0x0, sizeof(handle->slot));
+	handle->bus_dirty = false;
+
+	handle->stamp = 0;
+
+	// forget held ids of a previous activation, too, reset pool in next run
+	for(unsigned i=0; i<NODE_MAX; i++)
+		handle->node[i].state = NODE_FREE;
+	handle->hold_list.head = handle->hold_list.tail = -1;
+	handle->n_nodes = 0;
 }
 
-static LV2_Atom_Forge_Ref
-_osc_on(handle_t *handle, LV2_Atom_Forge *forge, int64_t frames,
-	const chimaera_event_t *cev)
+static inline LV2_Atom *
+_tmpl_arg(handle_t *handle, tmpl_t *tmpl, unsigned idx)
 {
-	const int32_t sid = (int32_t)floor(*handle->sid_offset)
-		+ cev->sid % (int32_t)floor(*handle->sid_wrap);
-	const int32_t gid = (int32_t)floor(*handle->gid_offset) + cev->gid;
-	const int32_t out = (int32_t)floor(*handle->out_offset) + cev->gid;
-	const int32_t id = handle->i_group ? gid : sid;
-	const int32_t arg_offset = (int32_t)floor(*handle->arg_offset);
-	const int32_t arg_num = 4;
+	const LV2_Atom_String *path;
+	const LV2_Atom_String *format;
+	const LV2_Atom_Tuple *arguments;
+
+	osc_atom_message_unpack(&handle->oforge, (const LV2_Atom_Object *)&tmpl->atom,
+		&path, &format, &arguments);
+	if(!arguments)
+		return NULL;
+
+	LV2_ATOM_TUPLE_FOREACH(arguments, itr)
+	{
+		if(idx-- == 0)
+			return (LV2_Atom *)itr;
+	}
+
+	return NULL;
+}
 
+static inline int32_t *
+_tmpl_int(handle_t *handle, tmpl_t *tmpl, unsigned idx)
+{
+	LV2_Atom *atom = _tmpl_arg(handle, tmpl, idx);
+
+	return atom ? &((LV2_Atom_Int *)atom)->body : NULL;
+}
+
+static inline float *
+_tmpl_float(handle_t *handle, tmpl_t *tmpl, unsigned idx)
+{
+	LV2_Atom *atom = _tmpl_arg(handle, tmpl, idx);
+
+	return atom ? &((LV2_Atom_Float *)atom)->body : NULL;
+}
+
+static bool
+_tmpl_build(handle_t *handle, tmpl_t *tmpl, const char *path, const char *fmt, ...)
+{
+	LV2_Atom_Forge forge = handle->forge;
 	LV2_Atom_Forge_Ref ref;
+	va_list args;
 
-	if(handle->i_allocate)
+	memset(tmpl, 0x0, sizeof(tmpl_t));
+	lv2_atom_forge_set_buffer(&forge, tmpl->buf, TMPL_SIZE);
+
+	va_start(args, fmt);
+	ref = osc_forge_message_varlist(&handle->oforge, &forge, path, fmt, args);
+	va_end(args);
+
+	if(!ref)
 	{
-		ref = lv2_atom_forge_frame_time(forge, frames);
-		if(handle->i_gate)
+		tmpl->atom.size = 0; // unusable, e.g. overlong synth name
+		return false;
+	}
+
+	return true;
+}
+
+// rebuild templates outside the event loop whenever their constant parts change
+static void
+_tmpl_update(handle_t *handle)
+{
+	const int32_t out_offset = floor(*handle->out_offset);
+	const int32_t gid_offset = floor(*handle->gid_offset);
+	const int32_t arg_offset = floor(*handle->arg_offset);
+
+	if(  !handle->dirty
+		&& (handle->i_out_offset == out_offset)
+		&& (handle->i_gid_offset == gid_offset)
+		&& (handle->i_arg_offset == arg_offset)
+		&& (handle->t_allocate == handle->i_allocate)
+		&& (handle->t_gate == handle->i_gate) )
+		return;
+
+	handle->dirty = false;
+	handle->i_out_offset = out_offset;
+	handle->i_gid_offset = gid_offset;
+	handle->i_arg_offset = arg_offset;
+	handle->t_allocate = handle->i_allocate;
+	handle->t_gate = handle->i_gate;
+
+	for(unsigned i=0; i<SYNTH_NAMES; i++)
+	{
+		tmpl_t *tmpl = &handle->s_new[i];
+		const int32_t gid = gid_offset + i;
+		const int32_t out = out_offset + i;
+		bool ok;
+
+		if(!handle->i_allocate)
 		{
-			if(ref)
-			{
-				ref = osc_forge_message_vararg(&handle->oforge, forge,
-					"/s_new", "siiiiisisi",
-					handle->state.synth_name[cev->gid], id, 0, gid,
-					arg_offset + 4, cev->pid,
-					"gate", 1,
-					"out", out);
-				(void)ref;
-			}
+			memset(tmpl, 0x0, sizeof(tmpl_t));
+			continue;
 		}
-		else // !handle->i_gate
+
+		if(handle->i_gate)
+			ok = _tmpl_build(handle, tmpl, "/s_new", "siiiiisisi",
+				handle->state.synth_name[i], 0, 0, gid,
+				arg_offset + ARG_NUM, 0,
+				"gate", 1,
+				"out", out);
+		else
+			ok = _tmpl_build(handle, tmpl, "/s_new", "siiiiisi",
+				handle->state.synth_name[i], 0, 0, gid,
+				arg_offset + ARG_NUM, 0,
+				"out", out);
+
+		if(ok)
 		{
-			if(ref)
-			{
-				ref = osc_forge_message_vararg(&handle->oforge, forge,
-					"/s_new", "siiiiisi",
-					handle->state.synth_name[cev->gid], id, 0, gid,
-					arg_offset + 4, cev->pid,
-					"out", out);
-				(void)ref;
-			}
+			tmpl->id = _tmpl_int(handle, tmpl, 1);
+			tmpl->pid = _tmpl_int(handle, tmpl, 5);
 		}
 	}
-	else if(handle->i_gate)
+
+	for(unsigned i=0; i<2; i++)
 	{
-		ref = lv2_atom_forge_frame_time(forge, frames);
-		if(ref)
+		tmpl_t *tmpl = &handle->n_set[i];
+
+		if(_tmpl_build(handle, tmpl, "/n_set", "isi",
+				0,
+				"gate", i))
+			tmpl->id = _tmpl_int(handle, tmpl, 0);
+	}
+
+	{
+		tmpl_t *tmpl = &handle->n_setn;
+
+		if(_tmpl_build(handle, tmpl, "/n_setn", "iiiffff",
+				0, arg_offset, ARG_NUM,
+				0.f, 0.f, 0.f, 0.f))
 		{
-			ref = osc_forge_message_vararg(&handle->oforge, forge,
-				"/n_set", "isi",
-				id,
-				"gate", 1);
-			(void)ref;
+			tmpl->id = _tmpl_int(handle, tmpl, 0);
+			for(unsigned j=0; j<ARG_NUM; j++)
+				tmpl->arg[j] = _tmpl_float(handle, tmpl, 3 + j);
 		}
 	}
+}
+
+static inline uint64_t
+_osc_timestamp(handle_t *handle, int64_t frames)
+{
+	const double t = frames + handle->i_latency;
+
+	if(handle->osc_sched)
+		return handle->osc_sched->frames2osc(handle->osc_sched->handle, t);
+
+	return handle->t0 + (uint64_t)(t / handle->rate * 0x100000000ULL);
+}
+
+static inline LV2_Atom_Forge_Ref
+_bundle_close(handle_t *handle, LV2_Atom_Forge *forge)
+{
+	if(handle->bundle_open)
+	{
+		osc_forge_bundle_pop(&handle->oforge, forge, handle->bundle_frame);
+		handle->bundle_open = false;
+	}
+
+	return 1;
+}
+
+// prepares the sequence for the next message, which either goes into the
+// currently open bundle or becomes an event of its own
+static inline LV2_Atom_Forge_Ref
+_osc_frame(handle_t *handle, LV2_Atom_Forge *forge, int64_t frames)
+{
+	LV2_Atom_Forge_Ref ref;
+
+	if(handle->i_bundle == BUNDLE_NONE)
+		return lv2_atom_forge_frame_time(forge, frames);
+
+	if(handle->bundle_open)
+	{
+		if( (handle->i_bundle == BUNDLE_BLOCK) || (handle->bundle_frames == frames) )
+			return 1;
+
+		_bundle_close(handle, forge);
+	}
 
 	ref = lv2_atom_forge_frame_time(forge, frames);
+	if(ref)
+		ref = osc_forge_bundle_push(&handle->oforge, forge, handle->bundle_frame,
+			_osc_timestamp(handle, frames));
 	if(ref)
 	{
-		ref = osc_forge_message_vararg(&handle->oforge, forge,
-			"/n_setn", "iiiffff",
-			id, arg_offset, arg_num,
-			cev->x, cev->z, cev->X, cev->Z);
+		handle->bundle_open = true;
+		handle->bundle_frames = frames;
 	}
 
 	return ref;
 }
 
+static inline LV2_Atom_Forge_Ref
+_tmpl_forge(handle_t *handle, LV2_Atom_Forge *forge, int64_t frames,
+	const tmpl_t *tmpl)
+{
+	LV2_Atom_Forge_Ref ref;
+
+	if(!tmpl->atom.size)
+		return 1; // skip message
+
+	CHIMAERA_PROBE1(osc_emit, lv2_atom_total_size(&tmpl->atom));
+
+	ref = _osc_frame(handle, forge, frames);
+	if(ref)
+		ref = lv2_atom_forge_write(forge, &tmpl->atom, lv2_atom_total_size(&tmpl->atom));
+
+	return ref;
+}
+
+static inline void
+_tmpl_patch_args(tmpl_t *tmpl, const chimaera_event_t *cev)
+{
+	if(!tmpl->atom.size)
+		return;
+
+	*tmpl->arg[0] = cev->x;
+	*tmpl->arg[1] = cev->z;
+	*tmpl->arg[2] = cev->X;
+	*tmpl->arg[3] = cev->Z;
+}
+
+static inline int32_t
+_osc_id(handle_t *handle, const chimaera_event_t *cev)
+{
+	if(handle->i_group)
+		return handle->i_gid_offset + cev->gid;
+
+	const int32_t *idx = chimaera_dict_ref(handle->node_dict, cev->sid);
+	if(!idx)
+		return -1;
+
+	return (int32_t)floor(*handle->sid_offset) + *idx;
+}
+
 static LV2_Atom_Forge_Ref
-_osc_off(handle_t *handle, LV2_Atom_Forge *forge, int64_t frames,
+_osc_on(handle_t *handle, LV2_Atom_Forge *forge, int64_t frames,
 	const chimaera_event_t *cev)
 {
-	const int32_t sid = (int32_t)floor(*handle->sid_offset)
-		+ cev->sid % (int32_t)floor(*handle->sid_wrap);
-	const int32_t gid = (int32_t)floor(*handle->gid_offset) + cev->gid;
-	const int32_t id = handle->i_group ? gid : sid;
+	if(!handle->i_group)
+	{
+		int32_t *idx = chimaera_dict_add(handle->node_dict, cev->sid);
+		if(!idx)
+			return 1;
+
+		if( (*idx = _pool_alloc(handle, cev->gid)) < 0)
+		{
+			chimaera_dict_del(handle->node_dict, cev->sid);
+			return 1;
+		}
+	}
+
+	const int32_t id = _osc_id(handle, cev);
 
 	LV2_Atom_Forge_Ref ref = 1;
 
-	if(handle->i_gate)
+	if(handle->i_allocate)
 	{
-		ref = lv2_atom_forge_frame_time(forge, frames);
-		if(ref)
+		tmpl_t *tmpl = &handle->s_new[cev->gid % SYNTH_NAMES];
+
+		if(tmpl->atom.size)
 		{
-			ref = osc_forge_message_vararg(&handle->oforge, forge,
-				"/n_set", "isi",
-				id,
-				"gate", 0);
+			*tmpl->id = id;
+			*tmpl->pid = cev->pid;
 		}
+		ref = _tmpl_forge(handle, forge, frames, tmpl);
+	}
+	else if(handle->i_gate)
+	{
+		tmpl_t *tmpl = &handle->n_set[1];
+
+		if(tmpl->atom.size)
+			*tmpl->id = id;
+		ref = _tmpl_forge(handle, forge, frames, tmpl);
+	}
+	(void)ref;
+
+	tmpl_t *tmpl = &handle->n_setn;
+
+	if(tmpl->atom.size)
+		*tmpl->id = id;
+	_tmpl_patch_args(tmpl, cev);
+
+	return _tmpl_forge(handle, forge, frames, tmpl);
+}
+
+static LV2_Atom_Forge_Ref
+_osc_off(handle_t *handle, LV2_Atom_Forge *forge, int64_t frames,
+	const chimaera_event_t *cev)
+{
+	const int32_t id = _osc_id(handle, cev);
+
+	LV2_Atom_Forge_Ref ref = 1;
+
+	if(id < 0)
+		return ref;
+
+	if(!handle->i_group)
+	{
+		const int32_t *idx = chimaera_dict_del(handle->node_dict, cev->sid);
+		_pool_release(handle, *idx);
+	}
+
+	if(handle->i_gate)
+	{
+		tmpl_t *tmpl = &handle->n_set[0];
+
+		if(tmpl->atom.size)
+			*tmpl->id = id;
+		ref = _tmpl_forge(handle, forge, frames, tmpl);
 	}
 
 	return ref;
@@ -303,42 +843,216 @@ static LV2_Atom_Forge_Ref
 _osc_set(handle_t *handle, LV2_Atom_Forge *forge, int64_t frames,
 	const chimaera_event_t *cev)
 {
-	const int32_t sid = (int32_t)floor(*handle->sid_offset)
-		+ cev->sid % (int32_t)floor(*handle->sid_wrap);
-	const int32_t gid = (int32_t)floor(*handle->gid_offset) + cev->gid;
-	const int32_t id = handle->i_group ? gid : sid;
-	const int32_t arg_offset = (int32_t)floor(*handle->arg_offset);
-	const int32_t arg_num = 4;
+	const int32_t id = _osc_id(handle, cev);
+	tmpl_t *tmpl = &handle->n_setn;
+
+	if(id < 0)
+		return 1;
+
+	if(tmpl->atom.size)
+		*tmpl->id = id;
+	_tmpl_patch_args(tmpl, cev);
+
+	return _tmpl_forge(handle, forge, frames, tmpl);
+}
+
+static inline void
+_bus_set(handle_t *handle, slot_t *slot, float gate, const chimaera_event_t *cev)
+{
+	slot->val[0] = gate;
+	slot->val[1] = cev->x;
+	slot->val[2] = cev->z;
+	slot->val[3] = cev->X;
+	slot->val[4] = cev->Z;
+	slot->dirty = true;
+
+	handle->bus_dirty = true;
+}
+
+static inline void
+_bus_event(handle_t *handle, const chimaera_event_t *cev)
+{
+	slot_t *slot;
+
+	switch(cev->state)
+	{
+		case CHIMAERA_STATE_ON:
+			if( (slot = chimaera_dict_add(handle->dict, cev->sid)) )
+				_bus_set(handle, slot, 1.f, cev);
+			break;
+		case CHIMAERA_STATE_SET:
+			if( (slot = chimaera_dict_ref(handle->dict, cev->sid)) )
+				_bus_set(handle, slot, 1.f, cev);
+			break;
+		case CHIMAERA_STATE_OFF:
+			if( (slot = chimaera_dict_del(handle->dict, cev->sid)) )
+				_bus_set(handle, slot, 0.f, cev);
+			break;
+		case CHIMAERA_STATE_IDLE:
+			chimaera_dict_clear(handle->dict);
+			for(unsigned i=0; i<CHIMAERA_DICT_SIZE; i++)
+			{
+				slot = &handle->slot[i];
+				if(slot->val[0] != 0.f)
+				{
+					slot->val[0] = 0.f;
+					slot->dirty = true;
+					handle->bus_dirty = true;
+				}
+			}
+			break;
+	}
+}
 
+// one /c_setn with a bus range per run of consecutive changed slots
+static LV2_Atom_Forge_Ref
+_bus_flush(handle_t *handle, LV2_Atom_Forge *forge, int64_t frames)
+{
+	const int32_t bus_offset = floor(*handle->bus_offset);
+	char fmt [CHIMAERA_DICT_SIZE*(2 + BUS_NUM) + 1];
+	char *ptr = fmt;
+	LV2_Atom_Forge_Frame frame [2];
 	LV2_Atom_Forge_Ref ref;
+	uint32_t offset = 0;
 
-	ref = lv2_atom_forge_frame_time(forge, frames);
+	if(!handle->bus_dirty)
+		return 1;
+	handle->bus_dirty = false;
+
+	for(unsigned i=0; i<CHIMAERA_DICT_SIZE; i++)
+	{
+		if(!handle->slot[i].dirty)
+			continue;
+
+		if( (i == 0) || !handle->slot[i-1].dirty)
+		{
+			*ptr++ = 'i'; // first bus
+			*ptr++ = 'i'; // number of buses
+		}
+		for(unsigned j=0; j<BUS_NUM; j++)
+			*ptr++ = 'f';
+	}
+	*ptr = '\0';
+
+	ref = _osc_frame(handle, forge, frames);
 	if(ref)
 	{
-		ref = osc_forge_message_vararg(&handle->oforge, forge,
-			"/n_setn", "iiiffff",
-			id, arg_offset, arg_num,
-			cev->x, cev->z, cev->X, cev->Z);
+		offset = forge->offset;
+		ref = osc_forge_message_push(&handle->oforge, forge, frame, "/c_setn", fmt);
 	}
 
+	for(unsigned i=0; (i<CHIMAERA_DICT_SIZE) && ref; i++)
+	{
+		if(!handle->slot[i].dirty)
+			continue;
+
+		if( (i == 0) || !handle->slot[i-1].dirty)
+		{
+			unsigned n = 0;
+			while( (i + n < CHIMAERA_DICT_SIZE) && handle->slot[i + n].dirty)
+				n++;
+
+			if(ref)
+				ref = osc_forge_int32(&handle->oforge, forge, bus_offset + i*BUS_NUM);
+			if(ref)
+				ref = osc_forge_int32(&handle->oforge, forge, n*BUS_NUM);
+		}
+
+		for(unsigned j=0; (j<BUS_NUM) && ref; j++)
+			ref = osc_forge_float(&handle->oforge, forge, handle->slot[i].val[j]);
+	}
+
+	if(ref)
+	{
+		osc_forge_message_pop(&handle->oforge, forge, frame);
+		CHIMAERA_PROBE1(osc_emit, forge->offset - offset);
+	}
+
+	for(unsigned i=0; i<CHIMAERA_DICT_SIZE; i++)
+		handle->slot[i].dirty = false;
+
 	return ref;
 }
 
+// gates off and releases all sounding nodes, like an OFF for each of them
+static LV2_Atom_Forge_Ref
+_osc_release_all(handle_t *handle, LV2_Atom_Forge *forge, int64_t frames)
+{
+	LV2_Atom_Forge_Ref ref = 1;
+	uint32_t sid;
+	int32_t *idx;
+
+	CHIMAERA_DICT_FOREACH(handle->node_dict, sid, idx)
+	{
+		if(ref && handle->i_gate)
+		{
+			tmpl_t *tmpl = &handle->n_set[0];
+
+			if(tmpl->atom.size)
+				*tmpl->id = (int32_t)floor(*handle->sid_offset) + *idx;
+			ref = _tmpl_forge(handle, forge, frames, tmpl);
+		}
+
+		_pool_release(handle, *idx);
+	}
+	chimaera_dict_clear(handle->node_dict);
+
+	return ref;
+}
+
+// gates off all sounding voice slots
+static void
+_bus_release_all(handle_t *handle)
+{
+	chimaera_event_t cev = {
+		.state = CHIMAERA_STATE_IDLE
+	};
+
+	_bus_event(handle, &cev);
+}
+
 static LV2_Atom_Forge_Ref
 _osc_idle(handle_t *handle, LV2_Atom_Forge *forge, int64_t frames,
 	const chimaera_event_t *cev)
 {
-	return 1;
+	return _osc_release_all(handle, forge, frames);
 }
 
 static void
 run(LV2_Handle instance, uint32_t nsamples)
 {
 	handle_t *handle = (handle_t *)instance;
+
+	CHIMAERA_PROBE_RUN_ENTRY(CHIMAERA_OSC_OUT_URI, nsamples, handle->event_in);
 	
 	handle->i_allocate = *handle->allocate != 0.f;
 	handle->i_gate = *handle->gate != 0.f;
-	handle->i_group = *handle->group != 0.f;
+
+	handle->i_bundle = handle->bundle ? floor(*handle->bundle) : BUNDLE_NONE;
+	handle->i_latency = handle->latency ? *handle->latency * 1e-3 * handle->rate : 0.0;
+
+	_tmpl_update(handle);
+
+	// free nodes whose synths have ended or whose hold time has passed
+	if(handle->osc_in)
+	{
+		LV2_ATOM_SEQUENCE_FOREACH(handle->osc_in, ev)
+		{
+			osc_atom_event_unroll(&handle->oforge, (const LV2_Atom_Object *)&ev->body,
+				NULL, NULL, _osc_in_message, handle);
+		}
+	}
+	const double hold = handle->hold ? *handle->hold * 1e-3 * handle->rate : 0.0;
+	_pool_expire(handle, hold);
+
+	if( (handle->i_bundle != BUNDLE_NONE) && !handle->osc_sched)
+	{
+		struct timespec ts;
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		handle->t0 = ((ts.tv_sec + JAN_1970) << 32)
+			+ ((uint64_t)ts.tv_nsec << 32) / 1000000000ULL;
+	}
 
 	// prepare osc atom forge
 	const uint32_t capacity = handle->osc_out->atom.size;
@@ -347,18 +1061,76 @@ run(LV2_Handle instance, uint32_t nsamples)
 	LV2_Atom_Forge_Frame frame;
 	LV2_Atom_Forge_Ref ref;
 	ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+	int64_t last = 0;
+
+	// switching between nodes and buses, or between per-blob and per-group
+	// nodes, ends all sounding voices of the previous mode
+	const int i_bus = handle->bus ? *handle->bus != 0.f : 0;
+	const int i_group = *handle->group != 0.f;
+	if(handle->i_bus && !i_bus)
+	{
+		_bus_release_all(handle);
+		if(ref)
+			ref = _bus_flush(handle, forge, 0);
+		memset(handle->slot, 0x0, sizeof(handle->slot));
+	}
+	else if(!handle->i_bus && !handle->i_group && (i_bus || i_group) && ref)
+		ref = _osc_release_all(handle, forge, 0);
+	handle->i_bus = i_bus;
+	handle->i_group = i_group;
+
+	// (re)size node id pool, sounding nodes would lose their ids otherwise
+	int32_t n_nodes = floor(*handle->sid_wrap);
+	if(n_nodes < 1)
+		n_nodes = 1;
+	else if(n_nodes > NODE_MAX)
+		n_nodes = NODE_MAX;
+	if(n_nodes != handle->n_nodes)
+	{
+		if(ref && handle->n_nodes)
+			ref = _osc_release_all(handle, forge, 0);
+		_pool_reset(handle, n_nodes);
+	}
 
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
 	{
 		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
 		int64_t frames = ev->time.frames;
 
-		if(  !props_advance(&handle->props, forge, frames, obj, &ref)
-			&& chimaera_event_check_type(&handle->cforge, &obj->atom) && ref)
+		last = frames;
+
+		if(chimaera_latency_check_type(&handle->cforge, &obj->atom))
+		{
+			chimaera_latency_t lat;
+
+			chimaera_latency_deforge(&handle->cforge, &obj->atom, &lat);
+			chimaera_latency_stats_add(&handle->latency_stats, &lat,
+				chimaera_latency_now());
+		}
+		else if(!chimaera_event_check_type(&handle->cforge, &obj->atom))
+		{
+			// patch responses must not end up inside a bundle, only patch:Get
+			// forges one, keep bundling across everything else
+			if(ref && lv2_atom_forge_is_object_type(forge, obj->atom.type)
+				&& (obj->body.otype == handle->props.urid.patch_get) )
+			{
+				ref = _bundle_close(handle, forge);
+			}
+
+			if(props_advance(&handle->props, forge, frames, obj, &ref))
+				_tmpl_update(handle); // synth names may have changed
+		}
+		else if(ref)
 		{
 			chimaera_event_t cev;
 			chimaera_event_deforge(&handle->cforge, &obj->atom, &cev);
 
+			if(handle->i_bus)
+			{
+				_bus_event(handle, &cev);
+				continue;
+			}
+
 			switch(cev.state)
 			{
 				case CHIMAERA_STATE_ON:
@@ -377,10 +1149,28 @@ run(LV2_Handle instance, uint32_t nsamples)
 		}
 	}
 
+	// all changed voice slots in one message
+	if(ref && handle->i_bus)
+		ref = _bus_flush(handle, forge, last);
+
+	if(ref)
+		ref = _bundle_close(handle, forge);
+
 	if(ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
+		CHIMAERA_PROBE1(forge_overflow, CHIMAERA_OSC_OUT_URI);
 		lv2_atom_sequence_clear(handle->osc_out);
+	}
+
+	chimaera_latency_stats_report(&handle->latency_stats, handle->latency_quant,
+		handle->latency_chain, handle->latency_max);
+
+	handle->bundle_open = false;
+	handle->stamp += nsamples;
+
+	CHIMAERA_PROBE_RUN_EXIT(CHIMAERA_OSC_OUT_URI, handle->osc_out);
 }
 
 static void
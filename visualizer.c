@@ -20,25 +20,107 @@
 #include <math.h>
 
 #include <chimaera.h>
+#include <visualizer_shm.h>
 
+#define RUN_GAP 2 // bridge gaps up to this size, cheaper than a new run header
+#define SHM_MISSES 3 // unanswered segment announcements until notify port is used again
+
+typedef struct _ref_t ref_t;
+typedef struct _shm_job_t shm_job_t;
 typedef struct _handle_t handle_t;
 
+// latest state of a blob, sent to the UI on the next tick if dirty
+struct _ref_t {
+	chimaera_event_t cev;
+	int dirty;
+};
+
+// segment as created by the worker, NULL if not available
+struct _shm_job_t {
+	vis_shm_t *shm;
+	char name [VIS_SHM_NAME_SIZE];
+};
+
 struct _handle_t {
 	const LV2_Atom_Sequence *event_in;
 	LV2_Atom_Sequence *event_out;
 	LV2_Atom_Sequence *notify;
 	const float *sensors;
 	const float *fps;
+	const float *threshold;
+	const float *use_shm;
 
 	LV2_URID_Map *map;
+	LV2_Worker_Schedule *sched;
 	chimaera_forge_t cforge;
 
+	chimaera_dict_t dict [CHIMAERA_DICT_SIZE];
+	ref_t ref [CHIMAERA_DICT_SIZE];
+
 	uint32_t rate;
 	uint32_t cnt;
 	uint32_t thresh;
 
 	int dump_waiting;
 	int event_waiting;
+
+	// dump as last sent to the UI, deltas are relative to it, buffers grow
+	// from the pool with the sensor count
+	chimaera_pool_t pool;
+	uint32_t n_values;
+	int32_t *values;
+	uint32_t max_values;
+	int32_t *runs;
+	uint32_t max_runs;
+	uint32_t keyframe;
+
+	// optional shared memory dump channel, bypasses the notify port once a UI
+	// has confirmed that it reads the segment
+	vis_shm_t *shm;
+	char shm_name [VIS_SHM_NAME_SIZE];
+	int shm_requested;
+	int shm_active;
+	uint32_t shm_keyframe;
+	uint32_t shm_missed;
+};
+
+// non-rt
+static LV2_Worker_Status
+_work(LV2_Handle instance, LV2_Worker_Respond_Function respond,
+	LV2_Worker_Respond_Handle target, uint32_t size, const void *body)
+{
+	handle_t *handle = instance;
+	shm_job_t job;
+
+	memset(&job, 0x0, sizeof(shm_job_t));
+	job.shm = vis_shm_create(job.name, handle);
+	if(!job.shm)
+		fprintf(stderr, "%s: shared memory not available, dumps go via notify port\n",
+			CHIMAERA_VISUALIZER_URI);
+
+	return respond(target, sizeof(shm_job_t), &job);
+}
+
+// rt-safe
+static LV2_Worker_Status
+_work_response(LV2_Handle instance, uint32_t size, const void *body)
+{
+	handle_t *handle = instance;
+	const shm_job_t *job = body;
+
+	if(job->shm)
+	{
+		memcpy(handle->shm_name, job->name, VIS_SHM_NAME_SIZE);
+		handle->shm = job->shm;
+	}
+
+	return LV2_WORKER_SUCCESS;
+}
+
+static const LV2_Worker_Interface work_iface = {
+	.work = _work,
+	.work_response = _work_response,
+	.end_run = NULL
 };
 
 static LV2_Handle
@@ -51,8 +133,12 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	
 	for(i=0; features[i]; i++)
+	{
 		if(!strcmp(features[i]->URI, LV2_URID__map))
 			handle->map = (LV2_URID_Map *)features[i]->data;
+		else if(!strcmp(features[i]->URI, LV2_WORKER__schedule))
+			handle->sched = (LV2_Worker_Schedule *)features[i]->data;
+	}
 	
 	if(!handle->map)
 	{
@@ -61,9 +147,23 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	if(chimaera_pool_init(&handle->pool, CHIMAERA_POOL_SIZE))
+	{
+		fprintf(stderr, "%s: failed to reserve memory pool\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
 	chimaera_forge_init(&handle->cforge, handle->map);
+	CHIMAERA_DICT_INIT(handle->dict, handle->ref);
 
 	handle->rate = rate;
+	handle->shm_missed = SHM_MISSES;
+
+	// the segment is only created once the shm port is turned on
+	if(!handle->sched)
+		fprintf(stderr, "%s: Host does not support work:schedule, dumps go via notify port\n",
+			descriptor->URI);
 
 	return handle;
 }
@@ -90,6 +190,12 @@ connect_port(LV2_Handle instance, uint32_t port, void *data)
 		case 4:
 			handle->notify = (LV2_Atom_Sequence *)data;
 			break;
+		case 5:
+			handle->threshold = (const float *)data;
+			break;
+		case 6:
+			handle->use_shm = (const float *)data;
+			break;
 		default:
 			break;
 	}
@@ -101,6 +207,65 @@ activate(LV2_Handle instance)
 	handle_t *handle = (handle_t *)instance;
 
 	handle->cnt = 0;
+	chimaera_dict_clear(handle->dict);
+	handle->n_values = 0; // start with a keyframe
+	handle->shm_active = 0; // announce segment anew
+}
+
+// collects values differing from the last sent ones by more than thresh,
+// returns the encoded size or -1 if a full dump is cheaper, a run extension
+// may overshoot n by up to RUN_GAP before bailing out
+static int32_t
+_delta_encode(handle_t *handle, const int32_t *values, uint32_t n, int32_t thresh)
+{
+	int32_t *runs = handle->runs;
+	uint32_t len = 0;
+	uint32_t head = 0; // position of count of current run
+	uint32_t last = 0; // index of last changed sensor
+	int open = 0;
+
+	for(uint32_t i=0; i<n; i++)
+	{
+		const int32_t diff = values[i] - handle->values[i];
+		if( (diff <= thresh) && (diff >= -thresh) )
+			continue;
+
+		if(open && (i - last <= RUN_GAP + 1) )
+		{
+			// extend current run, including the bridged sensors
+			for(uint32_t j=last+1; j<=i; j++)
+				runs[len++] = values[j];
+			runs[head] += i - last;
+		}
+		else
+		{
+			if(len + 3 > n)
+				return -1;
+
+			runs[len++] = i;
+			head = len;
+			runs[len++] = 1;
+			runs[len++] = values[i];
+			open = 1;
+		}
+
+		last = i;
+
+		if(len >= n)
+			return -1;
+	}
+
+	// remember what the UI will see
+	for(uint32_t i=0; i<len; )
+	{
+		const int32_t idx = runs[i++];
+		const int32_t cnt = runs[i++];
+
+		for(int32_t j=0; j<cnt; j++)
+			handle->values[idx + j] = runs[i++];
+	}
+
+	return len;
 }
 
 static void
@@ -108,10 +273,23 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	handle_t *handle = (handle_t *)instance;
 
+	CHIMAERA_PROBE_RUN_ENTRY(CHIMAERA_VISUALIZER_URI, nsamples, handle->event_in);
+
 	// clone event_in to event_out
 	memcpy(handle->event_out, handle->event_in,
 		sizeof(LV2_Atom) + handle->event_in->atom.size);
 
+	const int use_shm = handle->use_shm && (*handle->use_shm != 0.f);
+
+	// create segment off the rt thread on first use
+	if(use_shm && !handle->shm_requested && handle->sched)
+	{
+		const uint8_t create = 1;
+
+		handle->shm_requested = handle->sched->schedule_work(handle->sched->handle,
+			sizeof(create), &create) == LV2_WORKER_SUCCESS;
+	}
+
 	// update sample count threshold
 	handle->thresh = handle->rate / *handle->fps;
 
@@ -139,12 +317,32 @@ run(LV2_Handle instance, uint32_t nsamples)
 		if(chimaera_event_check_type(&handle->cforge, atom))
 		{
 			chimaera_event_t cev;
+			ref_t *dst;
 			chimaera_event_deforge(&handle->cforge, atom, &cev);
 
-			if(  (cev.state == CHIMAERA_STATE_SET)
-				&& !handle->event_waiting)
+			// only remember latest state of SET, it goes out on the next tick
+			switch(cev.state)
 			{
-				continue;
+				case CHIMAERA_STATE_ON:
+					if( (dst = chimaera_dict_add(handle->dict, cev.sid)) )
+					{
+						dst->cev = cev;
+						dst->dirty = 0;
+					}
+					break;
+				case CHIMAERA_STATE_SET:
+					if( (dst = chimaera_dict_ref(handle->dict, cev.sid)) )
+					{
+						dst->cev = cev;
+						dst->dirty = 1;
+					}
+					continue;
+				case CHIMAERA_STATE_OFF:
+					chimaera_dict_del(handle->dict, cev.sid);
+					break;
+				case CHIMAERA_STATE_IDLE:
+					chimaera_dict_clear(handle->dict);
+					break;
 			}
 
 			if(ref)
@@ -154,31 +352,131 @@ run(LV2_Handle instance, uint32_t nsamples)
 			if(ref)
 				lv2_atom_forge_pad(forge, atom->size);
 		}
+		else if(chimaera_shm_check_type(&handle->cforge, atom))
+		{
+			// a UI confirms that it reads the segment
+			const char *name = chimaera_shm_deforge(&handle->cforge, atom);
+
+			if(handle->shm && name && !strcmp(name, handle->shm_name))
+				handle->shm_missed = 0;
+		}
 		else if(chimaera_dump_check_type(&handle->cforge, atom))
 		{
 			if(handle->dump_waiting)
 			{
-				if(ref)
-					ref = lv2_atom_forge_frame_time(forge, ev->time.frames);
-				if(ref)
-					ref = lv2_atom_forge_raw(forge, atom, sizeof(LV2_Atom) + atom->size);
-				if(ref)
-					lv2_atom_forge_pad(forge, atom->size);
+				const chimaera_dump_t *dump = (const chimaera_dump_t *)atom;
+				const uint32_t n = (dump->cobj.prop.value.size - sizeof(LV2_Atom_Vector_Body))
+					/ sizeof(int32_t);
+				const int32_t *values = chimaera_dump_deforge(&handle->cforge, atom, NULL);
+				const int32_t thresh = handle->threshold ? floor(*handle->threshold) : 0;
+				int32_t len = 0;
+
+				// dumps beyond the fixed slot size go via notify port
+				if(handle->shm && use_shm && (n <= VIS_SHM_VALUES) )
+				{
+					vis_shm_write(handle->shm, values, n);
+
+					// periodic announcement for UIs opened later on, each UI that
+					// reads the segment answers it
+					if(!handle->shm_active || (handle->shm_keyframe++ >= *handle->fps) )
+					{
+						if(ref)
+							ref = lv2_atom_forge_frame_time(forge, ev->time.frames);
+						if(ref)
+							ref = chimaera_shm_forge(&handle->cforge, handle->shm_name);
+
+						handle->shm_keyframe = 0;
+						handle->shm_active = 1;
+						if(handle->shm_missed < SHM_MISSES)
+							handle->shm_missed += 1;
+					}
+
+					// without a confirmation, dumps go via notify port as well
+					if(handle->shm_missed < SHM_MISSES)
+					{
+						handle->n_values = 0; // keyframe when falling back to notify port
+						handle->dump_waiting = 0;
+						continue;
+					}
+				}
+				else
+					handle->shm_active = 0;
+
+				// without room for the baseline, every dump goes out as keyframe
+				const int tracked = !chimaera_pool_reserve(&handle->pool,
+						(void **)&handle->values, &handle->max_values, n, sizeof(int32_t))
+					&& !chimaera_pool_reserve(&handle->pool,
+						(void **)&handle->runs, &handle->max_runs, n + RUN_GAP + 1, sizeof(int32_t));
+
+				// periodic keyframe to recover from UI notifications lost by the host
+				const int keyframe = !tracked || (n != handle->n_values)
+					|| (handle->keyframe++ >= *handle->fps);
+
+				if(!keyframe)
+					len = _delta_encode(handle, values, n, thresh);
+
+				if(keyframe || (len < 0) )
+				{
+					if(ref)
+						ref = lv2_atom_forge_frame_time(forge, ev->time.frames);
+					if(ref)
+						ref = lv2_atom_forge_raw(forge, atom, sizeof(LV2_Atom) + atom->size);
+					if(ref)
+						lv2_atom_forge_pad(forge, atom->size);
+
+					if(tracked)
+						memcpy(handle->values, values, n*sizeof(int32_t));
+					handle->n_values = tracked ? n : 0;
+					handle->keyframe = 0;
+				}
+				else if(len > 0)
+				{
+					if(ref)
+						ref = lv2_atom_forge_frame_time(forge, ev->time.frames);
+					if(ref)
+						ref = chimaera_delta_forge(&handle->cforge, handle->runs, len);
+				}
 
 				handle->dump_waiting = 0;
 			}
 		}
 	}
 
+	// one SET per changed blob and tick, regardless of event rate
+	if(handle->event_waiting)
+	{
+		const int64_t last = nsamples ? nsamples - 1 : 0;
+		uint32_t sid;
+		ref_t *dst;
+
+		CHIMAERA_DICT_FOREACH(handle->dict, sid, dst)
+		{
+			if(!dst->dirty)
+				continue;
+
+			if(ref)
+				ref = lv2_atom_forge_frame_time(forge, last);
+			if(ref)
+				ref = chimaera_event_forge(&handle->cforge, &dst->cev);
+
+			dst->dirty = 0;
+		}
+	}
+
 	if(ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
+		CHIMAERA_PROBE1(forge_overflow, CHIMAERA_VISUALIZER_URI);
 		lv2_atom_sequence_clear(handle->notify);
+	}
 
 	// increase sample counter
 	handle->cnt += nsamples;
 
 	handle->event_waiting = 0;
+
+	CHIMAERA_PROBE_RUN_EXIT(CHIMAERA_VISUALIZER_URI, handle->notify);
 }
 
 static void
@@ -193,12 +491,18 @@ cleanup(LV2_Handle instance)
 {
 	handle_t *handle = (handle_t *)instance;
 
+	if(handle->shm)
+		vis_shm_destroy(handle->shm, handle->shm_name);
+	chimaera_pool_deinit(&handle->pool);
 	free(handle);
 }
 
 static const void*
 extension_data(const char* uri)
 {
+	if(!strcmp(uri, LV2_WORKER__interface))
+		return &work_iface;
+
 	return NULL;
 }
 
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _VISUALIZER_SHM_H
+#define _VISUALIZER_SHM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#if !defined(_WIN32)
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
+// Shared-memory dump channel from visualizer plugin to its UI.
+//
+// The plugin creates a named POSIX shm segment at instantiation and announces
+// its name on the notify port. Each dump tick it writes the sensor values
+// into the next slot of a small ring, guarded by a per-slot sequence counter
+// (odd while being written), and then publishes the slot as the newest one.
+// The UI maps the segment read-only and copies the newest consistent slot at
+// render time, no locks are taken on either side.
+
+#define VIS_SHM_MAGIC 0x4d494843 // 'CHIM'
+#define VIS_SHM_VERSION 1
+#define VIS_SHM_SLOTS 4
+#define VIS_SHM_VALUES 160
+#define VIS_SHM_NAME_SIZE 64
+
+typedef struct _vis_shm_slot_t vis_shm_slot_t;
+typedef struct _vis_shm_t vis_shm_t;
+
+struct _vis_shm_slot_t {
+	atomic_uint seq;
+	uint32_t sensors;
+	int32_t values [VIS_SHM_VALUES];
+};
+
+struct _vis_shm_t {
+	uint32_t magic;
+	uint32_t version;
+	atomic_uint frame; // number of frames published so far
+	uint32_t pad;
+	vis_shm_slot_t slot [VIS_SHM_SLOTS];
+};
+
+#if !defined(_WIN32)
+// non-rt, creates and maps a new segment, returns NULL on failure
+static inline vis_shm_t *
+vis_shm_create(char *name, const void *owner)
+{
+	snprintf(name, VIS_SHM_NAME_SIZE, "/chimaera_visualizer.%i.%p",
+		(int)getpid(), owner);
+
+	const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if(fd < 0)
+		return NULL;
+
+	if(ftruncate(fd, sizeof(vis_shm_t)))
+	{
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+
+	vis_shm_t *shm = mmap(NULL, sizeof(vis_shm_t), PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	close(fd);
+	if(shm == MAP_FAILED)
+	{
+		shm_unlink(name);
+		return NULL;
+	}
+
+	// pages are zeroed by ftruncate, only header needs initialization
+	shm->magic = VIS_SHM_MAGIC;
+	shm->version = VIS_SHM_VERSION;
+	atomic_init(&shm->frame, 0);
+	for(unsigned i=0; i<VIS_SHM_SLOTS; i++)
+		atomic_init(&shm->slot[i].seq, 0);
+
+	return shm;
+}
+
+// non-rt
+static inline void
+vis_shm_destroy(vis_shm_t *shm, const char *name)
+{
+	munmap(shm, sizeof(vis_shm_t));
+	shm_unlink(name);
+}
+
+// non-rt, maps an existing segment read-only, returns NULL on failure
+static inline const vis_shm_t *
+vis_shm_open(const char *name)
+{
+	const int fd = shm_open(name, O_RDONLY, 0);
+	if(fd < 0)
+		return NULL;
+
+	const vis_shm_t *shm = mmap(NULL, sizeof(vis_shm_t), PROT_READ,
+		MAP_SHARED, fd, 0);
+	close(fd);
+	if(shm == MAP_FAILED)
+		return NULL;
+
+	if( (shm->magic != VIS_SHM_MAGIC) || (shm->version != VIS_SHM_VERSION) )
+	{
+		munmap((void *)shm, sizeof(vis_shm_t));
+		return NULL;
+	}
+
+	return shm;
+}
+
+// non-rt
+static inline void
+vis_shm_close(const vis_shm_t *shm)
+{
+	munmap((void *)shm, sizeof(vis_shm_t));
+}
+#else
+static inline vis_shm_t *
+vis_shm_create(char *name, const void *owner)
+{
+	return NULL; // fall back to notify port
+}
+
+static inline void
+vis_shm_destroy(vis_shm_t *shm, const char *name)
+{
+	// nothing
+}
+
+static inline const vis_shm_t *
+vis_shm_open(const char *name)
+{
+	return NULL;
+}
+
+static inline void
+vis_shm_close(const vis_shm_t *shm)
+{
+	// nothing
+}
+#endif
+
+// rt-safe, single writer
+static inline void
+vis_shm_write(vis_shm_t *shm, const int32_t *values, uint32_t sensors)
+{
+	if(sensors > VIS_SHM_VALUES)
+		sensors = VIS_SHM_VALUES;
+
+	const unsigned frame = atomic_load_explicit(&shm->frame, memory_order_relaxed);
+	vis_shm_slot_t *slot = &shm->slot[frame % VIS_SHM_SLOTS];
+	const unsigned seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+	atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot->sensors = sensors;
+	memcpy(slot->values, values, sensors * sizeof(int32_t));
+
+	atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+	atomic_store_explicit(&shm->frame, frame + 1, memory_order_release);
+}
+
+// copies the newest frame if there is one newer than *last,
+// returns the number of sensors copied or 0
+static inline uint32_t
+vis_shm_read(const vis_shm_t *shm, unsigned *last, int32_t *values)
+{
+	for(unsigned retry=0; retry<VIS_SHM_SLOTS; retry++)
+	{
+		const unsigned frame = atomic_load_explicit((atomic_uint *)&shm->frame,
+			memory_order_acquire);
+		if(!frame || (frame == *last) )
+			return 0; // nothing new
+
+		const vis_shm_slot_t *slot = &shm->slot[(frame - 1) % VIS_SHM_SLOTS];
+		const unsigned seq1 = atomic_load_explicit((atomic_uint *)&slot->seq,
+			memory_order_acquire);
+		if(seq1 & 1)
+			continue; // being written
+
+		uint32_t sensors = slot->sensors;
+		if(sensors > VIS_SHM_VALUES)
+			sensors = VIS_SHM_VALUES;
+		memcpy(values, slot->values, sensors * sizeof(int32_t));
+
+		atomic_thread_fence(memory_order_acquire);
+		const unsigned seq2 = atomic_load_explicit((atomic_uint *)&slot->seq,
+			memory_order_relaxed);
+		if(seq1 != seq2)
+			continue; // overwritten while copying
+
+		*last = frame;
+		return sensors;
+	}
+
+	return 0; // writer too fast, try again on next frame
+}
+
+#endif // _VISUALIZER_SHM_H
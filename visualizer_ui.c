@@ -16,6 +16,7 @@
  */
 
 #include <chimaera.h>
+#include <visualizer_shm.h>
 
 #include <Ecore.h>
 #include <Ecore_Evas.h>
@@ -23,12 +24,19 @@
 
 #include <lv2_eo_ui.h>
 
+#define SENSOR_DEFAULT 160 // until the sensors port or a dump tells otherwise
+#define VALUE_MAX 0x7ff
+#define IMG_H 256 // vertical resolution of sensor bars
+#define HIST_N 256 // number of dump frames in waterfall history
+
 typedef struct _UI UI;
 typedef struct _ref_t ref_t;
 
 struct _ref_t {
 	chimaera_event_t cev;
 	Evas_Object *obj;
+	int shown;
+	int label_needs_update;
 };
 
 struct _UI {
@@ -44,104 +52,331 @@ struct _UI {
 	LV2UI_Controller controller;
 
 	LV2UI_Port_Map *port_map;
+	uint32_t control_port;
 	uint32_t sensor_port;
 	uint32_t notify_port;
 
 	uint32_t sensors;
-	int32_t values [160];
+	uint32_t max_sensors; // capacity of values and bars
+	int32_t *values;
+	int32_t *bars; // signed bar heights currently drawn
+	uint32_t lut_north [VALUE_MAX + 1];
+	uint32_t lut_south [VALUE_MAX + 1];
+	uint32_t lut_fall [2*VALUE_MAX + 1];
+	unsigned head; // waterfall row to be written next
 
 	chimaera_dict_t dict [CHIMAERA_DICT_SIZE];
 	ref_t ref [CHIMAERA_DICT_SIZE];
 
 	char theme_path[512];
 
+	// shared memory dump channel as announced by the plugin
+	const vis_shm_t *shm;
+	char shm_name [VIS_SHM_NAME_SIZE];
+	unsigned shm_frame;
+
 	volatile int dump_needs_update;
 	volatile int event_needs_update;
 
-	Evas_Object *tab;
+	Evas_Object *box;
+	Evas_Object *img;
+	Evas_Object *fall;
+	Ecore_Animator *anim;
 };
 
 static void
-_dump_fill(UI *ui)
+_lut_fill(UI *ui)
+{
+	for(unsigned v=0; v<=VALUE_MAX; v++)
+	{
+		const uint8_t red = v * 0xbb / VALUE_MAX;
+
+		ui->lut_north[v] = 0xff000000 | (0xbb << 16) | ((0xbb-red) << 8) | (0xbb-red);
+		ui->lut_south[v] = 0xff000000 | ((0xbb-red) << 16) | (0xbb << 8) | (0xbb-red);
+
+		// waterfall fades from black into red (north) or green (south)
+		ui->lut_fall[VALUE_MAX - v] = 0xff000000 | (red << 16);
+		ui->lut_fall[VALUE_MAX + v] = 0xff000000 | (red << 8);
+	}
+}
+
+// the history image is a ring buffer, the fill origin is moved such that the
+// row written last ends up at the bottom, tiling wraps the older rows around
+static void
+_fall_scroll(UI *ui)
+{
+	int w, h;
+	evas_object_geometry_get(ui->fall, NULL, NULL, &w, &h);
+
+	const int off = (ui->head * h + HIST_N/2) / HIST_N;
+	evas_object_image_fill_set(ui->fall, 0, -off, w, h);
+}
+
+static void
+_fall_resize(void *data, Evas *e, Evas_Object *obj, void *event_info)
+{
+	UI *ui = data;
+
+	_fall_scroll(ui);
+}
+
+static void
+_fall_fill(UI *ui)
 {
-	elm_table_clear(ui->tab, EINA_TRUE);
+	evas_object_image_size_set(ui->fall, ui->sensors, HIST_N);
+
+	uint32_t *pixels = evas_object_image_data_get(ui->fall, EINA_TRUE);
+	if(pixels)
+	{
+		const int stride = evas_object_image_stride_get(ui->fall) / sizeof(uint32_t);
+
+		for(unsigned y=0; y<HIST_N; y++)
+			for(unsigned i=0; i<ui->sensors; i++)
+				pixels[y*stride + i] = ui->lut_fall[VALUE_MAX];
+
+		evas_object_image_data_set(ui->fall, pixels);
+		evas_object_image_data_update_add(ui->fall, 0, 0, ui->sensors, HIST_N);
+	}
+
+	ui->head = 0;
+	_fall_scroll(ui);
+}
+
+static void
+_fall_update(UI *ui)
+{
+	uint32_t *pixels = evas_object_image_data_get(ui->fall, EINA_TRUE);
+	if(!pixels)
+		return;
+
+	const int stride = evas_object_image_stride_get(ui->fall) / sizeof(uint32_t);
+	uint32_t *dst = &pixels[ui->head * stride];
 
 	for(unsigned i=0; i<ui->sensors; i++)
 	{
-		Evas_Object *edj;
-
-		Evas_Object *north = elm_layout_add(ui->tab);
-		elm_layout_file_set(north, ui->theme_path,
-			CHIMAERA_VISUALIZER_UI_URI"/sensor");
-		evas_object_size_hint_weight_set(north, EVAS_HINT_EXPAND, EVAS_HINT_EXPAND);
-		evas_object_size_hint_align_set(north, EVAS_HINT_FILL, EVAS_HINT_FILL);
-		edj = elm_layout_edje_get(north);
-		edje_object_part_drag_value_set(edj, "sensor", 0.5, 1.f);
-		edje_object_part_drag_size_set(edj, "sensor", 1.f, 0.f);
-		evas_object_show(north);
-		elm_table_pack(ui->tab, north, i, 0, 1, 1);
-
-		Evas_Object *south = elm_layout_add(ui->tab);
-		elm_layout_file_set(south, ui->theme_path,
-			CHIMAERA_VISUALIZER_UI_URI"/sensor");
-		evas_object_size_hint_weight_set(south, EVAS_HINT_EXPAND, EVAS_HINT_EXPAND);
-		evas_object_size_hint_align_set(south, EVAS_HINT_FILL, EVAS_HINT_FILL);
-		edj = elm_layout_edje_get(south);
-		edje_object_part_drag_value_set(edj, "sensor", 0.5, 0.f);
-		edje_object_part_drag_size_set(edj, "sensor", 1.f, 0.f);
-		evas_object_show(south);
-		elm_table_pack(ui->tab, south, i, 1, 1, 1);
+		int32_t val = ui->values[i];
+		if(val > VALUE_MAX)
+			val = VALUE_MAX;
+		else if(val < -VALUE_MAX)
+			val = -VALUE_MAX;
+
+		dst[i] = ui->lut_fall[VALUE_MAX + val];
+	}
+
+	evas_object_image_data_set(ui->fall, pixels);
+	evas_object_image_data_update_add(ui->fall, 0, ui->head, ui->sensors, 1);
+
+	ui->head = (ui->head + 1) % HIST_N;
+	_fall_scroll(ui);
+}
+
+static void
+_dump_fill(UI *ui)
+{
+	// one pixel column per sensor, north bars grow up, south bars down
+	evas_object_image_size_set(ui->img, ui->sensors, IMG_H);
+
+	uint32_t *pixels = evas_object_image_data_get(ui->img, EINA_TRUE);
+	if(pixels)
+	{
+		const int stride = evas_object_image_stride_get(ui->img) / sizeof(uint32_t);
 
+		for(unsigned y=0; y<IMG_H; y++)
+			memset(&pixels[y*stride], 0x0, ui->sensors * sizeof(uint32_t));
+
+		evas_object_image_data_set(ui->img, pixels);
+		evas_object_image_data_update_add(ui->img, 0, 0, ui->sensors, IMG_H);
+	}
+
+	for(unsigned i=0; i<ui->sensors; i++)
+	{
 		ui->values[i] = 0;
+		ui->bars[i] = 0;
 	}
 
+	_fall_fill(ui);
+
 	ui->dump_needs_update = 1;
 }
 
+// confirms to the plugin that the segment is read, until then and after
+// a couple of unanswered announcements, dumps go via notify port as well
+static inline void
+_write_shm_ack(UI *ui)
+{
+	uint8_t buf[128];
+
+	lv2_atom_forge_set_buffer(&ui->cforge.forge, buf, 128);
+	if(!chimaera_shm_forge(&ui->cforge, ui->shm_name))
+		return;
+
+	ui->write_function(ui->controller, ui->control_port, ui->cforge.forge.offset,
+		ui->uris.event_transfer, buf);
+}
+
+// grows the buffers as needed, keeps the old sensor count on failure
+static void
+_sensors_set(UI *ui, uint32_t sensors)
+{
+	if(!sensors || (sensors == ui->sensors) )
+		return;
+
+	if(sensors > ui->max_sensors)
+	{
+		int32_t *values = realloc(ui->values, sensors * sizeof(int32_t));
+		if(!values)
+			return;
+		ui->values = values;
+
+		int32_t *bars = realloc(ui->bars, sensors * sizeof(int32_t));
+		if(!bars)
+			return;
+		ui->bars = bars;
+
+		ui->max_sensors = sensors;
+	}
+
+	ui->sensors = sensors;
+	_dump_fill(ui);
+}
+
 static void
 _dump_update(UI *ui)
 {
 	int32_t *values = ui->values;
 
+	uint32_t *pixels = evas_object_image_data_get(ui->img, EINA_TRUE);
+	if(!pixels)
+		return;
+
+	const int stride = evas_object_image_stride_get(ui->img) / sizeof(uint32_t);
+	const int mid = IMG_H / 2;
+
 	for(unsigned i=0; i<ui->sensors; i++)
 	{
-		Evas_Object *north = elm_table_child_get(ui->tab, i, 0);
-		Evas_Object *south = elm_table_child_get(ui->tab, i, 1);
-		double rel = values[i];
-		rel *= 1.f / 0x7ff;
-		double north_size = rel < 0.f ? -rel : 0.f;
-		double south_size = rel < 0.f ? 0.f : rel;
-		uint8_t red = rel < 0.f ? (-rel)*0xbb : rel*0xbb;
-
-		//printf("%i %i %lf %lf %lf\n", i, values[i], rel, north_size, south_size);
-
-		evas_object_color_set(north, 0xbb, 0xbb-red, 0xbb-red, 0xff);
-		evas_object_color_set(south, 0xbb-red, 0xbb, 0xbb-red, 0xff);
-
-		Evas_Object *edj;
-		edj = elm_layout_edje_get(north);
-		edje_object_part_drag_size_set(edj, "sensor", 1.f, north_size);
-		edj = elm_layout_edje_get(south);
-		edje_object_part_drag_size_set(edj, "sensor", 1.f, south_size);
+		int32_t val = values[i];
+		if(val > VALUE_MAX)
+			val = VALUE_MAX;
+		else if(val < -VALUE_MAX)
+			val = -VALUE_MAX;
+
+		const int32_t mag = val < 0 ? -val : val;
+		const int32_t bar = (val < 0 ? -1 : 1) * mag * mid / VALUE_MAX;
+
+		if(bar == ui->bars[i])
+			continue; // column unchanged
+
+		const uint32_t col = val < 0 ? ui->lut_north[mag] : ui->lut_south[mag];
+		const int top = bar < 0 ? mid + bar : mid;
+		const int bot = bar < 0 ? mid : mid + bar;
+
+		uint32_t *dst = &pixels[i];
+		for(int y=0; y<IMG_H; y++, dst += stride)
+			*dst = (y >= top) && (y < bot) ? col : 0x0;
+
+		ui->bars[i] = bar;
+		evas_object_image_data_update_add(ui->img, i, 0, 1, IMG_H);
 	}
+
+	evas_object_image_data_set(ui->img, pixels);
+
+	_fall_update(ui);
 }
 
 static void
 _event_update(UI *ui)
 {
 	int x, y, w, h;
-	evas_object_geometry_get(ui->tab, &x, &y, &w, &h);
+	evas_object_geometry_get(ui->img, &x, &y, &w, &h);
 
-	uint32_t sid;
-	ref_t *ref;
-	CHIMAERA_DICT_FOREACH(ui->dict, sid, ref)
+	for(unsigned i=0; i<CHIMAERA_DICT_SIZE; i++)
 	{
+		ref_t *ref = &ui->ref[i];
+
+		if(!ui->dict[i].sid) // inactive
+		{
+			if(ref->shown)
+			{
+				evas_object_hide(ref->obj);
+				ref->shown = 0;
+			}
+			continue;
+		}
+
+		if(ref->label_needs_update)
+		{
+			char buf [64];
+			sprintf(buf, "%i/%i", ref->cev.sid, ref->cev.gid);
+			elm_object_part_text_set(ref->obj, "elm.text", buf);
+			ref->label_needs_update = 0;
+		}
+
 		int sign = ref->cev.pid == 0x100 ? 1 : -1;
 		int abs_x = x + w * ref->cev.x - 12;
 		int abs_y = y + h/2 + (h/8 + 3*h/8 * ref->cev.z) * sign  - 12;
 
 		evas_object_move(ref->obj, abs_x, abs_y);
+
+		if(!ref->shown)
+		{
+			evas_object_show(ref->obj);
+			ref->shown = 1;
+		}
+	}
+}
+
+// render at most once per display frame, whatever the notification rate
+static Eina_Bool
+_animator(void *data)
+{
+	UI *ui = data;
+
+	// only the newest frame is of interest, intermediate ones are skipped
+	if(ui->shm)
+	{
+		int32_t values [VIS_SHM_VALUES];
+		uint32_t n = vis_shm_read(ui->shm, &ui->shm_frame, values);
+
+		if(n)
+		{
+			_sensors_set(ui, n);
+			if(n > ui->sensors)
+				n = ui->sensors;
+
+			memcpy(ui->values, values, n * sizeof(int32_t));
+			ui->dump_needs_update = 1;
+		}
+	}
+
+	if(ui->dump_needs_update)
+	{
+		_dump_update(ui);
+		ui->dump_needs_update = 0;
+	}
+
+	if(ui->event_needs_update)
+	{
+		_event_update(ui);
+		ui->event_needs_update = 0;
 	}
+
+	return ECORE_CALLBACK_RENEW;
+}
+
+static void
+_content_del(void *data, Evas *e, Evas_Object *obj, void *event_info)
+{
+	UI *ui = data;
+
+	if(ui->anim)
+	{
+		ecore_animator_del(ui->anim);
+		ui->anim = NULL;
+	}
+
+	ui->box = NULL;
+	ui->img = NULL;
+	ui->fall = NULL;
 }
 
 static Evas_Object *
@@ -149,9 +384,25 @@ _content_get(eo_ui_t *eoui)
 {
 	UI *ui = (void *)eoui - offsetof(UI, eoui);
 
-	ui->tab = elm_table_add(eoui->win);
-	elm_table_homogeneous_set(ui->tab, EINA_TRUE);
-	elm_table_align_set(ui->tab, 0.5, 0.5);
+	ui->box = elm_box_add(eoui->win);
+	elm_box_homogeneous_set(ui->box, EINA_TRUE);
+
+	ui->img = evas_object_image_filled_add(evas_object_evas_get(eoui->win));
+	evas_object_image_alpha_set(ui->img, EINA_TRUE);
+	evas_object_image_smooth_scale_set(ui->img, EINA_FALSE);
+	evas_object_size_hint_weight_set(ui->img, EVAS_HINT_EXPAND, EVAS_HINT_EXPAND);
+	evas_object_size_hint_align_set(ui->img, EVAS_HINT_FILL, EVAS_HINT_FILL);
+	evas_object_show(ui->img);
+	elm_box_pack_end(ui->box, ui->img);
+
+	// waterfall history, not filled as its fill origin scrolls
+	ui->fall = evas_object_image_add(evas_object_evas_get(eoui->win));
+	evas_object_image_smooth_scale_set(ui->fall, EINA_FALSE);
+	evas_object_event_callback_add(ui->fall, EVAS_CALLBACK_RESIZE, _fall_resize, ui);
+	evas_object_size_hint_weight_set(ui->fall, EVAS_HINT_EXPAND, EVAS_HINT_EXPAND);
+	evas_object_size_hint_align_set(ui->fall, EVAS_HINT_FILL, EVAS_HINT_FILL);
+	evas_object_show(ui->fall);
+	elm_box_pack_end(ui->box, ui->fall);
 
 	_dump_fill(ui);
 
@@ -160,13 +411,19 @@ _content_get(eo_ui_t *eoui)
 	{
 		ref_t *ref = &ui->ref[i];
 
-		ref->obj = elm_layout_add(ui->tab);
+		ref->obj = elm_layout_add(eoui->win);
 		elm_layout_file_set(ref->obj, ui->theme_path,
 			CHIMAERA_VISUALIZER_UI_URI"/indicator");
 		evas_object_resize(ref->obj, 24, 24);
+		ref->shown = 0;
+		ref->label_needs_update = 1;
 	}
 
-	return ui->tab;
+	evas_object_event_callback_add(ui->box, EVAS_CALLBACK_DEL, _content_del, ui);
+	ui->anim = ecore_animator_add(_animator, ui);
+	ui->event_needs_update = 1;
+
+	return ui->box;
 }
 
 static LV2UI_Handle
@@ -201,7 +458,18 @@ instantiate(const LV2UI_Descriptor *descriptor,
 	eoui->w = 1280,
 	eoui->h = 720;
 
-	ui->sensors = 160;
+	ui->values = calloc(SENSOR_DEFAULT, sizeof(int32_t));
+	ui->bars = calloc(SENSOR_DEFAULT, sizeof(int32_t));
+	if(!ui->values || !ui->bars)
+	{
+		free(ui->values);
+		free(ui->bars);
+		free(ui);
+		return NULL;
+	}
+	ui->sensors = SENSOR_DEFAULT;
+	ui->max_sensors = SENSOR_DEFAULT;
+	_lut_fill(ui);
 	ui->write_function = write_function;
 	ui->controller = controller;
 
@@ -216,17 +484,22 @@ instantiate(const LV2UI_Descriptor *descriptor,
 	if(!ui->map)
 	{
 		fprintf(stderr, "%s: Host does not support urid:map\n", descriptor->URI);
+		free(ui->values);
+		free(ui->bars);
 		free(ui);
 		return NULL;
 	}
 	if(!ui->port_map)
 	{
 		fprintf(stderr, "%s: Host does not support ui:portMap\n", descriptor->URI);
+		free(ui->values);
+		free(ui->bars);
 		free(ui);
 		return NULL;
 	}
 
 	// query port index of "control" port
+	ui->control_port = ui->port_map->port_index(ui->port_map->handle, "event_in");
 	ui->sensor_port = ui->port_map->port_index(ui->port_map->handle, "sensors");
 	ui->notify_port = ui->port_map->port_index(ui->port_map->handle, "notify");
 
@@ -238,6 +511,8 @@ instantiate(const LV2UI_Descriptor *descriptor,
 	if(eoui_instantiate(eoui, descriptor, plugin_uri, bundle_path, write_function,
 		controller, widget, features))
 	{
+		free(ui->values);
+		free(ui->bars);
 		free(ui);
 		return NULL;
 	}
@@ -250,7 +525,13 @@ cleanup(LV2UI_Handle handle)
 {
 	UI *ui = handle;
 
+	if(ui->anim)
+		ecore_animator_del(ui->anim);
+	if(ui->shm)
+		vis_shm_close(ui->shm);
 	eoui_cleanup(&ui->eoui);
+	free(ui->values);
+	free(ui->bars);
 	free(ui);
 }
 
@@ -262,13 +543,7 @@ port_event(LV2UI_Handle handle, uint32_t i, uint32_t size, uint32_t urid,
 
 	if(i == ui->sensor_port)
 	{
-		uint32_t sensors = *(float *)buf;
-
-		if(sensors != ui->sensors)
-		{
-			ui->sensors = sensors;
-			_dump_fill(ui);
-		}
+		_sensors_set(ui, *(float *)buf);
 	}
 	else if( (i == ui->notify_port) && (urid == ui->uris.event_transfer) )
 	{
@@ -279,10 +554,40 @@ port_event(LV2UI_Handle handle, uint32_t i, uint32_t size, uint32_t urid,
 			uint32_t sensors;
 			const int32_t *values = chimaera_dump_deforge(&ui->cforge, atom, &sensors);
 
-			for(unsigned j=0; j<ui->sensors; j++)
+			_sensors_set(ui, sensors);
+			if(sensors > ui->sensors)
+				sensors = ui->sensors;
+			for(unsigned j=0; j<sensors; j++)
 				ui->values[j] = values[j];
 
-			_dump_update(ui);
+			ui->dump_needs_update = 1;
+		}
+		else if(chimaera_delta_check_type(&ui->cforge, atom))
+		{
+			uint32_t n;
+			const int32_t *runs = chimaera_delta_deforge(&ui->cforge, atom, &n);
+
+			chimaera_delta_apply(ui->values, ui->sensors, runs, n);
+
+			ui->dump_needs_update = 1;
+		}
+		else if(chimaera_shm_check_type(&ui->cforge, atom))
+		{
+			const char *name = chimaera_shm_deforge(&ui->cforge, atom);
+
+			if(name && strcmp(name, ui->shm_name))
+			{
+				if(ui->shm)
+					vis_shm_close(ui->shm);
+
+				// may fail for remote UIs, dumps then keep coming via notify port
+				ui->shm = vis_shm_open(name);
+				ui->shm_frame = 0;
+				strncpy(ui->shm_name, name, VIS_SHM_NAME_SIZE - 1);
+			}
+
+			if(ui->shm)
+				_write_shm_ack(ui);
 		}
 		else if(chimaera_event_check_type(&ui->cforge, atom))
 		{
@@ -307,21 +612,12 @@ port_event(LV2UI_Handle handle, uint32_t i, uint32_t size, uint32_t urid,
 					ref->cev.z = cev.z;
 					ref->cev.X = cev.X;
 					ref->cev.Z = cev.Z;
-
-					char buf2 [64];
-					sprintf(buf2, "%i/%i", ref->cev.sid, ref->cev.gid);
-					elm_object_part_text_set(ref->obj, "elm.text", buf2);
-					evas_object_show(ref->obj);
+					ref->label_needs_update = 1;
 
 					break;
 				}
 				case CHIMAERA_STATE_OFF:
 				{
-					ref_t *ref = chimaera_dict_ref(ui->dict, cev.sid);
-					if(!ref)
-						break;
-
-					evas_object_hide(ref->obj);
 					chimaera_dict_del(ui->dict, cev.sid);
 
 					break;
@@ -346,17 +642,13 @@ port_event(LV2UI_Handle handle, uint32_t i, uint32_t size, uint32_t urid,
 				}
 				case CHIMAERA_STATE_IDLE:
 				{
-					uint32_t sid;
-					ref_t *ref;
-					CHIMAERA_DICT_FOREACH(ui->dict, sid, ref)
-						evas_object_hide(ref->obj);
 					chimaera_dict_clear(ui->dict);
 
 					break;
 				}
 			}
 
-			_event_update(ui);
+			ui->event_needs_update = 1;
 		}
 	}
 }